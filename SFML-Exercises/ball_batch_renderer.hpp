@@ -0,0 +1,76 @@
+#ifndef BALL_BATCH_RENDERER_HPP
+#define BALL_BATCH_RENDERER_HPP
+
+// draws a whole set of balls in one draw call. every ball is a quad in one vertex array,
+// tinted by its vertex color, over a white anti-aliased circle rasterized once into a
+// texture; window.draw on each sf::CircleShape would send a 30-point fan per ball instead
+#include <cmath>
+#include <algorithm>
+#include <SFML/Graphics.hpp>
+
+class BallBatchRenderer {
+public:
+    // texture_size is the circle texture's width and height in pixels; needs a window first
+    bool initialize(unsigned int texture_size = 128) {
+        _textureSize = texture_size;
+        float center = texture_size / 2.f;
+        // one pixel of margin, so the smooth filter never reads past the edge of the disc
+        _circleRadius = center - 1.f;
+        sf::Image image;
+        image.create(texture_size, texture_size, sf::Color::Transparent);
+        for (unsigned int y = 0; y < texture_size; ++y) {
+            for (unsigned int x = 0; x < texture_size; ++x) {
+                // coverage of the pixel, from its center's distance to the edge
+                float d = std::hypot(x + 0.5f - center, y + 0.5f - center);
+                float coverage = std::max(0.f, std::min(1.f, _circleRadius - d + 0.5f));
+                image.setPixel(x, y, sf::Color(255, 255, 255, static_cast<sf::Uint8>(coverage * 255.f + 0.5f)));
+            }
+        }
+        if (!_texture.loadFromImage(image)) {
+            return false;
+        }
+        _texture.setSmooth(true);
+        // small balls sample the mipmaps instead of aliasing; fine if it isn't supported
+        _texture.generateMipmap();
+        _vertices.setPrimitiveType(sf::Quads);
+        return true;
+    }
+
+    // starts a new frame; the vertex array keeps its memory from the last one
+    void clear() {
+        _vertices.clear();
+    }
+
+    void add(const sf::Vector2f& center, float radius, const sf::Color& color) {
+        // the texture's disc is a little smaller than the texture, so the quad is a little bigger than the ball
+        float half = radius * (_textureSize / 2.f) / _circleRadius;
+        float t = static_cast<float>(_textureSize);
+        _vertices.append(sf::Vertex(sf::Vector2f(center.x - half, center.y - half), color, sf::Vector2f(0.f, 0.f)));
+        _vertices.append(sf::Vertex(sf::Vector2f(center.x + half, center.y - half), color, sf::Vector2f(t, 0.f)));
+        _vertices.append(sf::Vertex(sf::Vector2f(center.x + half, center.y + half), color, sf::Vector2f(t, t)));
+        _vertices.append(sf::Vertex(sf::Vector2f(center.x - half, center.y + half), color, sf::Vector2f(0.f, t)));
+    }
+
+    // a ball drawn the usual way, for one that has an sf::CircleShape already
+    void add(const sf::CircleShape& ball) {
+        add(ball.getPosition() - ball.getOrigin() + sf::Vector2f(ball.getRadius(), ball.getRadius()),
+            ball.getRadius(), ball.getFillColor());
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        if (_vertices.getVertexCount() == 0) return;
+        target.draw(_vertices, sf::RenderStates(&_texture));
+    }
+
+    std::size_t size() const {
+        return _vertices.getVertexCount() / 4;
+    }
+
+private:
+    sf::Texture _texture;
+    sf::VertexArray _vertices;
+    unsigned int _textureSize{1};
+    float _circleRadius{1.f};
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef FALLING_BALL_ENVS_HPP
+#define FALLING_BALL_ENVS_HPP
+
+// many falling-ball games stepped in lockstep, for training paddle agents.
+// the rules are a simplified project_main without SFML, with every game's state kept in
+// flat arrays: steady spawns, balls fall straight down, +10 score for each ball that
+// leaves the screen, -1 HP for each one that touches the paddle at any point of its step
+// (the same swept test as project_main), and the paddle stays on screen.
+// only plain balls are modeled: the power-ups, bombs and homing balls and the scripted
+// waves that project_main can turn on are left out, so games with those on won't match
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "game_rng.hpp"
+#include "swept_collision.hpp"
+
+namespace envs {
+    constexpr unsigned int max_observed_balls{16};
+
+    struct Config {
+        float width{1500.f};
+        float height{900.f};
+        float paddleWidth{100.f};
+        float paddleHeight{30.f};
+        // gap between the paddle and the bottom of the screen
+        float paddleGap{15.f};
+        float paddleSpeed{300.f};
+        int healthPoints{10};
+        float ballRadius{30.f};
+        float spawnPeriod{0.25f};
+        float minSpeed{100.f};
+        float maxSpeed{1000.f};
+        float delta{1.f / 144.f};
+        // ball slots per game; a spawn with no free slot is dropped
+        unsigned int maxBalls{64};
+        // lowest balls reported in each observation, at most max_observed_balls
+        unsigned int observedBalls{4};
+        // an episode also ends after this many steps
+        unsigned long maxSteps{144ul * 120};
+        // reward is +1 per ball that gets past and -hitPenalty per hit
+        float hitPenalty{10.f};
+    };
+
+    // actions, one byte per game
+    enum Action : std::uint8_t {stay, left, right};
+
+    class FallingBallEnvs {
+    public:
+        FallingBallEnvs(unsigned int count, const Config& config, std::uint64_t seed)
+            : _count(count), _config(config) {
+            _config.observedBalls = std::max(1u, std::min(_config.observedBalls, max_observed_balls));
+            unsigned int slots = count * config.maxBalls;
+            _ballX.assign(slots, 0.f);
+            _ballY.assign(slots, 0.f);
+            _ballVY.assign(slots, 0.f);
+            _alive.assign(slots, 0);
+            _paddleX.assign(count, 0.f);
+            _health.assign(count, 0);
+            _score.assign(count, 0);
+            _spawnClock.assign(count, 0.f);
+            _steps.assign(count, 0);
+            _rng.resize(count);
+            for (unsigned int e = 0; e < count; ++e) {
+                // one stream per game, all from the same seed
+                _rng[e] = rng::Pcg32(seed, e);
+            }
+            _observations.assign(count * observationSize(), 0.f);
+            _rewards.assign(count, 0.f);
+            _dones.assign(count, 0);
+            reset();
+        }
+
+        unsigned int size() const {
+            return _count;
+        }
+
+        // paddle x and HP, then x, y and fall speed of the lowest balls, all scaled to about [0, 1]
+        unsigned int observationSize() const {
+            return 2 + 3 * _config.observedBalls;
+        }
+
+        void reset() {
+            for (unsigned int e = 0; e < _count; ++e) {
+                resetGame(e);
+                observe(e);
+            }
+        }
+
+        // steps every game with actions[e]; finished games report done and start over
+        void step(const std::uint8_t* actions) {
+            stepRange(actions, 0, _count);
+        }
+
+        // steps games [begin, end) only, so callers can split a batch across threads
+        void stepRange(const std::uint8_t* actions, unsigned int begin, unsigned int end) {
+            for (unsigned int e = begin; e < end; ++e) {
+                stepGame(e, actions[e]);
+            }
+        }
+
+        const float* observations() const { return _observations.data(); }
+        const float* rewards() const { return _rewards.data(); }
+        const std::uint8_t* dones() const { return _dones.data(); }
+        unsigned int score(unsigned int e) const { return _score[e]; }
+
+    private:
+        void resetGame(unsigned int e) {
+            std::fill(_alive.begin() + e * _config.maxBalls, _alive.begin() + (e + 1) * _config.maxBalls, 0);
+            _paddleX[e] = _config.width / 2.f - _config.paddleWidth / 2.f;
+            _health[e] = _config.healthPoints;
+            _score[e] = 0;
+            _spawnClock[e] = 0.f;
+            _steps[e] = 0;
+        }
+
+        void stepGame(unsigned int e, std::uint8_t action) {
+            const Config& c = _config;
+            float paddle_v = action == left ? -c.paddleSpeed : action == right ? c.paddleSpeed : 0.f;
+            float paddleStart = _paddleX[e];
+            _paddleX[e] = std::max(0.f, std::min(_paddleX[e] + paddle_v * c.delta, c.width - c.paddleWidth));
+            float paddleShift = _paddleX[e] - paddleStart;
+            float paddleTop = c.height - c.paddleHeight - c.paddleGap;
+            float paddleBottom = paddleTop + c.paddleHeight;
+
+            // one flat loop over the game's slots; only balls whose step crossed the
+            // paddle's rows take the swept test, in the paddle's frame
+            float* x = &_ballX[e * c.maxBalls];
+            float* y = &_ballY[e * c.maxBalls];
+            const float* vy = &_ballVY[e * c.maxBalls];
+            std::uint8_t* alive = &_alive[e * c.maxBalls];
+            int passed = 0;
+            int hits = 0;
+            for (unsigned int m = 0; m < c.maxBalls; ++m) {
+                float fall = vy[m] * c.delta;
+                float ny = y[m] + fall;
+                int near = alive[m] & (ny + c.ballRadius >= paddleTop) & (y[m] - c.ballRadius <= paddleBottom);
+                int hit = near && swept::circleRectTime(x[m], y[m], -paddleShift, fall, c.ballRadius,
+                    paddleStart, paddleTop, paddleStart + c.paddleWidth, paddleBottom) <= 1.f;
+                int out = alive[m] & !hit & (ny + c.ballRadius > c.height);
+                passed += out;
+                hits += hit;
+                alive[m] &= !(out | hit);
+                y[m] = ny;
+            }
+            _score[e] += 10 * passed;
+            _health[e] = std::max(0, _health[e] - hits);
+
+            // steady spawns, each moved on by however long ago it came due
+            _spawnClock[e] += c.delta;
+            while (_spawnClock[e] >= c.spawnPeriod) {
+                _spawnClock[e] -= c.spawnPeriod;
+                spawn(e, _spawnClock[e]);
+            }
+
+            _rewards[e] = passed - c.hitPenalty * hits;
+            ++_steps[e];
+            _dones[e] = _health[e] <= 0 || _steps[e] >= c.maxSteps;
+            if (_dones[e]) {
+                resetGame(e);
+            }
+            observe(e);
+        }
+
+        void spawn(unsigned int e, float age) {
+            const Config& c = _config;
+            std::uint8_t* alive = &_alive[e * c.maxBalls];
+            std::uint8_t* slot = std::find(alive, alive + c.maxBalls, 0);
+            if (slot == alive + c.maxBalls) return;
+            unsigned int m = e * c.maxBalls + (slot - alive);
+            rng::Pcg32& gen = _rng[e];
+            float x = gen.range(0, c.width);
+            _ballX[m] = std::max(c.ballRadius, std::min(x, c.width - c.ballRadius));
+            _ballVY[m] = gen.uniform(c.minSpeed, c.maxSpeed);
+            _ballY[m] = c.ballRadius + _ballVY[m] * age;
+            *slot = 1;
+        }
+
+        // keeps the observedBalls lowest live balls with an insertion into a short list
+        void observe(unsigned int e) {
+            const Config& c = _config;
+            float* out = &_observations[e * observationSize()];
+            out[0] = _paddleX[e] / c.width;
+            out[1] = static_cast<float>(_health[e]) / c.healthPoints;
+
+            unsigned int found = 0;
+            unsigned int lowest[max_observed_balls];
+            for (unsigned int m = e * c.maxBalls; m < (e + 1) * c.maxBalls; ++m) {
+                if (!_alive[m]) continue;
+                unsigned int k = std::min(found, c.observedBalls - 1);
+                if (found >= c.observedBalls && _ballY[lowest[k]] >= _ballY[m]) continue;
+                for (; k > 0 && _ballY[lowest[k - 1]] < _ballY[m]; --k) {
+                    lowest[k] = lowest[k - 1];
+                }
+                lowest[k] = m;
+                found = std::min(found + 1, c.observedBalls);
+            }
+            for (unsigned int k = 0; k < c.observedBalls; ++k) {
+                float* ball = out + 2 + 3 * k;
+                if (k < found) {
+                    ball[0] = _ballX[lowest[k]] / c.width;
+                    ball[1] = _ballY[lowest[k]] / c.height;
+                    ball[2] = _ballVY[lowest[k]] / c.maxSpeed;
+                } else {
+                    ball[0] = ball[1] = ball[2] = 0.f;
+                }
+            }
+        }
+
+        unsigned int _count;
+        Config _config;
+        // per slot, game e owning [e * maxBalls, (e + 1) * maxBalls)
+        std::vector<float> _ballX, _ballY, _ballVY;
+        std::vector<std::uint8_t> _alive;
+        // per game
+        std::vector<float> _paddleX;
+        std::vector<int> _health;
+        std::vector<unsigned int> _score;
+        std::vector<float> _spawnClock;
+        std::vector<unsigned long> _steps;
+        std::vector<rng::Pcg32> _rng;
+        std::vector<float> _observations;
+        std::vector<float> _rewards;
+        std::vector<std::uint8_t> _dones;
+    };
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef GAME_RNG_HPP
+#define GAME_RNG_HPP
+
+// small, fast random numbers shared by the exercises.
+// every stream comes from one master seed, so logging that seed is enough to replay a run
+#include <cassert>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+
+namespace rng {
+    // PCG32 (XSH RR), https://www.pcg-random.org/
+    // 16 bytes of state; the increment picks one of 2^63 independent streams
+    struct Pcg32 {
+        typedef std::uint32_t result_type;
+
+        std::uint64_t state{0x853C49E6748FEA9Bull};
+        std::uint64_t increment{0xDA3E39CB94B95BDBull};
+
+        Pcg32() = default;
+        Pcg32(std::uint64_t seed, std::uint64_t stream) {
+            reseed(seed, stream);
+        }
+
+        void reseed(std::uint64_t seed, std::uint64_t stream) {
+            state = 0;
+            increment = (stream << 1) | 1;
+            next();
+            state += seed;
+            next();
+        }
+
+        std::uint32_t next() {
+            std::uint64_t old = state;
+            state = old * 6364136223846793005ull + increment;
+            std::uint32_t xorshifted = static_cast<std::uint32_t>(((old >> 18) ^ old) >> 27);
+            std::uint32_t rot = static_cast<std::uint32_t>(old >> 59);
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+
+        // so the <random> distributions still work with it
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return 0xFFFFFFFFu; }
+        result_type operator()() { return next(); }
+
+        // [0, bound) without modulo bias, Lemire's multiply-shift with rejection
+        std::uint32_t below(std::uint32_t bound) {
+            std::uint64_t product = static_cast<std::uint64_t>(next()) * bound;
+            std::uint32_t low = static_cast<std::uint32_t>(product);
+            if (low < bound) {
+                std::uint32_t threshold = (0u - bound) % bound;
+                while (low < threshold) {
+                    product = static_cast<std::uint64_t>(next()) * bound;
+                    low = static_cast<std::uint32_t>(product);
+                }
+            }
+            return static_cast<std::uint32_t>(product >> 32);
+        }
+
+        // [lo, hi], both ends included
+        int range(int lo, int hi) {
+            assert(lo <= hi);
+            return lo + static_cast<int>(below(static_cast<std::uint32_t>(hi - lo) + 1));
+        }
+
+        // [0, 1) on a 2^-24 grid, every value a float can hold exactly
+        float unit() {
+            return (next() >> 8) * (1.f / 16777216.f);
+        }
+
+        // [lo, hi)
+        float uniform(float lo, float hi) {
+            return lo + (hi - lo) * unit();
+        }
+    };
+
+    // hands out one stream per subsystem, so extra draws in one never shift another
+    struct Service {
+        std::uint64_t masterSeed{0};
+
+        // 0 picks a seed from the clock
+        void seed(std::uint64_t s) {
+            masterSeed = s != 0 ? s : static_cast<std::uint64_t>(time(NULL));
+        }
+
+        Pcg32 stream(std::uint64_t id) const {
+            return Pcg32(masterSeed, id);
+        }
+
+        void logSeed(std::ostream& out) const {
+            out << "rng seed: " << masterSeed << " (put it in the settings to replay this run)\n";
+        }
+    };
+}
+
+#endif
@@ -2,8 +2,8 @@
 #include <math.h>
 #include <vector>
 #include <fstream>
-#include <random>
 #include <SFML/Graphics.hpp>
+#include "game_rng.hpp"
 
 // constants
 constexpr unsigned int fps_limit{60};
@@ -39,6 +39,8 @@ float square_size{default_vals::square_size};
 float speed{default_vals::speed};
 float fcircle_speed{default_vals::fcircle_speed};
 float frectangle_speed{default_vals::frectangle_speed};
+std::uint64_t master_seed{0};
+rng::Service shapeRng;
 
 bool directionFlags[4] = {false, false, false, false};
 bool leftMouseButtonFlag = false;
@@ -56,6 +58,7 @@ bool readFromAvailableText() {
         settings >> speed;
         settings >> fcircle_speed;
         settings >> frectangle_speed;
+        settings >> master_seed;
         settings.close();
         return true;
     } else {
@@ -64,20 +67,20 @@ bool readFromAvailableText() {
 }
 
 void generateShapes() {
-    std::random_device rd; // this is deterministic in earlier versions of MinGW, so use rand() or some other random seed generation
-    std::mt19937 gen(rand()); // change to rd() if using MinGW 10
-    std::uniform_int_distribution<int> distrib_w(0, window_w-1); 
-    std::uniform_int_distribution<int> distrib_h(0, window_h-1);
+    // draw x before y; argument evaluation order isn't fixed, and replays need it to be
+    rng::Pcg32 gen = shapeRng.stream(0);
     for (unsigned int i = 0; i < rect_amount; ++i) {
         rectangles[i].setSize(sf::Vector2f(square_size, square_size));
         rectangles[i].setFillColor(color[i % color_amount]);
-        rectangles[i].setPosition(distrib_w(gen), distrib_h(gen));
+        int x = gen.below(window_w);
+        rectangles[i].setPosition(x, gen.below(window_h));
     }
 
     for (unsigned int i = 0; i < circ_amount; ++i) {
         circles[i].setRadius(circle_radius);
         circles[i].setFillColor(color[i % color_amount]);
-        circles[i].setPosition(distrib_w(gen), distrib_h(gen));
+        int x = gen.below(window_w);
+        circles[i].setPosition(x, gen.below(window_h));
     }
 }
 
@@ -87,6 +90,8 @@ void initializeSettings() {
     } else {
         std::cout << "hw03_settings.txt not loaded. Using default values.\n";
     }
+    shapeRng.seed(master_seed);
+    shapeRng.logSeed(std::cout);
     rectangles.resize(rect_amount);
     circles.resize(circ_amount);
     generateShapes();
@@ -204,7 +209,6 @@ void render(sf::RenderWindow& window) {
 
 
 int main() {
-    srand(time(NULL)); // random_device is deterministic on older MinGW versions, kept as failsafe
     sf::RenderWindow window(sf::VideoMode(window_w, window_h), "HW03 - Game of Squares and Circles");
     window.setFramerateLimit(fps_limit);
 
@@ -3,7 +3,20 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <numeric>
+#include <array>
+#include <string>
+#include <random>
+#include <ctime>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <SFML/Graphics.hpp>
+#include "ball_batch_renderer.hpp"
 
 namespace utility {
     // in case the person compiling this does not have C++17 installed
@@ -43,14 +56,91 @@ namespace default_vals {
         constexpr float elasticity{0.5f};
         constexpr float friction{0.05f};
     }
+    // update-rate tiers; bodies off-screen and far from the user get stepped less often
+    namespace tiers {
+        constexpr float full_rate_radius{400.f};
+        constexpr float half_rate_radius{1200.f};
+        constexpr float screen_margin{100.f};
+        // a slower body this close to a faster one gets promoted to its rate
+        constexpr float promotion_margin{30.f};
+        constexpr unsigned int promotion_hold_steps{16};
+    }
+    namespace scene {
+        constexpr unsigned int candidates_per_point{16};
+        // fraction of the arena Bridson sampling reliably fills, in points per (2 * max_radius)^2
+        constexpr float expected_density{0.6f};
+        constexpr float arena_growth{1.1f};
+    }
+}
+
+// collision categories; two bodies are paired only if each one's mask has the other's category
+namespace layers {
+    constexpr std::uint32_t user{1u << 0};
+    constexpr std::uint32_t enemy{1u << 1};
+    constexpr std::uint32_t trigger{1u << 2};
+    constexpr std::uint32_t all{0xFFFFFFFFu};
 }
 
+// tier 0 is stepped every fixed update, tier 1 every 2nd, tier 2 every 4th
+constexpr unsigned int num_rate_tiers{3};
+
+// a mass of 0 stands for an infinitely heavy (static) body
 struct Material {
     float mass{100.f};
     float elasticity{0.f};
     float friction{0.01f};
 };
 
+typedef unsigned char MaterialId;
+
+// flyweight material storage; bodies only carry a MaterialId
+// everything the contact path needs is precomputed per material and per ordered pair
+struct MaterialTable {
+    static constexpr unsigned int max_materials{16};
+    unsigned int count{0};
+    float inverseMass[max_materials];
+    float elasticity[max_materials];
+    float friction[max_materials];
+    // (1 + e_a) * (1/m_a) / (1/m_a + 1/m_b) for the pair (a, b); 0 when both are static
+    float velocityGain[max_materials][max_materials];
+    // (1/m_a) / (1/m_a + 1/m_b): a's share of the push-out for the pair (a, b); 0 when a is static
+    float pushShare[max_materials][max_materials];
+
+    MaterialId add(const Material& m) {
+        assert(count < max_materials);
+        MaterialId id = count++;
+        inverseMass[id] = m.mass > epsilon ? 1.f / m.mass : 0.f;
+        elasticity[id] = m.elasticity;
+        friction[id] = m.friction;
+        for (unsigned int other = 0; other < count; ++other) {
+            velocityGain[id][other] = pairGain(id, other);
+            velocityGain[other][id] = pairGain(other, id);
+            pushShare[id][other] = pairShare(id, other);
+            pushShare[other][id] = pairShare(other, id);
+        }
+        return id;
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+private:
+    float pairGain(unsigned int a, unsigned int b) const {
+        float inverseMassSum = inverseMass[a] + inverseMass[b];
+        if (inverseMassSum <= 0.f) return 0.f;
+        return (1 + elasticity[a]) * inverseMass[a] / inverseMassSum;
+    }
+
+    float pairShare(unsigned int a, unsigned int b) const {
+        float inverseMassSum = inverseMass[a] + inverseMass[b];
+        if (inverseMassSum <= 0.f) return 0.f;
+        return inverseMass[a] / inverseMassSum;
+    }
+};
+
+MaterialTable materials;
+
 template <typename T>
 T dot (const sf::Vector2<T>& a, const sf::Vector2<T>& b) {
     return a.x*b.x + a.y*b.y;
@@ -61,14 +151,109 @@ T cross (const sf::Vector2<T>& a, const sf::Vector2<T>& b) {
     return a.x*b.y - b.x*a.y;
 }
 
+// integrators; each advances pos and vel by delta, with accel(pos) giving the acceleration
+// pick one at compile time with -DHW06_INTEGRATOR=VelocityVerlet (or any of the names below)
+
+// the original scheme; exact for constant acceleration, drifts once forces depend on position
+struct ExplicitStep {
+    template <typename Accel>
+    static void step(sf::Vector2f& pos, sf::Vector2f& vel, float delta, Accel&& accel) {
+        sf::Vector2f a = accel(pos);
+        pos += a * 0.5f * delta * delta + vel * delta;
+        vel += a * delta;
+    }
+};
+
+struct SemiImplicitEuler {
+    template <typename Accel>
+    static void step(sf::Vector2f& pos, sf::Vector2f& vel, float delta, Accel&& accel) {
+        vel += accel(pos) * delta;
+        pos += vel * delta;
+    }
+};
+
+struct VelocityVerlet {
+    template <typename Accel>
+    static void step(sf::Vector2f& pos, sf::Vector2f& vel, float delta, Accel&& accel) {
+        sf::Vector2f a0 = accel(pos);
+        pos += vel * delta + a0 * 0.5f * delta * delta;
+        vel += (a0 + accel(pos)) * 0.5f * delta;
+    }
+};
+
+// 4th order Forest-Ruth / Yoshida; three force evaluations per step
+struct ForestRuth {
+    static constexpr double cbrt2{1.2599210498948732};
+    static constexpr float w1{static_cast<float>(1.0 / (2.0 - cbrt2))};
+    static constexpr float w0{static_cast<float>(-cbrt2 / (2.0 - cbrt2))};
+    static constexpr float c1{w1 / 2.f};
+    static constexpr float c2{(w0 + w1) / 2.f};
+
+    template <typename Accel>
+    static void step(sf::Vector2f& pos, sf::Vector2f& vel, float delta, Accel&& accel) {
+        pos += vel * (c1 * delta);
+        vel += accel(pos) * (w1 * delta);
+        pos += vel * (c2 * delta);
+        vel += accel(pos) * (w0 * delta);
+        pos += vel * (c2 * delta);
+        vel += accel(pos) * (w1 * delta);
+        pos += vel * (c1 * delta);
+    }
+};
+
+#ifndef HW06_INTEGRATOR
+#define HW06_INTEGRATOR ExplicitStep
+#endif
+typedef HW06_INTEGRATOR DefaultIntegrator;
+
+// closed-form motion of a body sliding with no contacts and no applied force
+// mirrors moveEntity step for step: move by the current speed, then lose friction * delta of it
+struct CoastState {
+    bool active{false};
+    bool friction{false}; // the friction toggle it started under
+    unsigned long long startStep{0}; // the step whose end state is origin/speed
+    unsigned long long wakeStep{0}; // stepped normally again from this step on
+    unsigned long long movingSteps{0}; // steps until it stops, when slowdown > 0
+    sf::Vector2f origin;
+    sf::Vector2f direction;
+    float speed{0.f};
+    float slowdown{0.f}; // speed lost per step
+    float delta{0.f};
+    sf::FloatRect bounds; // all the ground covered before stopping or waking
+
+    float distanceAfter(unsigned long long steps) const {
+        if (slowdown > 0.f) steps = std::min(steps, movingSteps);
+        double k = static_cast<double>(steps);
+        return static_cast<float>(delta * (k * speed - slowdown * k * (k - 1) / 2));
+    }
+
+    float speedAfter(unsigned long long steps) const {
+        float s = speed - steps * slowdown;
+        return s > epsilon ? s : 0.f;
+    }
+};
+
 struct BallEntity {
     sf::CircleShape ball;
-    Material material;
+    MaterialId materialId{0};
     float radius;
     sf::Vector2f velocity;
+    sf::Vector2f anchor; // spawn point, where springs pull toward
     sf::Color colorNoFriction{sf::Color::Green};
     sf::Color colorFriction{sf::Color::Red};
 
+    // multi-rate bookkeeping
+    unsigned int rateTier{0};
+    unsigned int promotionHold{0};
+    float pendingDelta{0.f}; // simulated time not yet applied to this body
+    bool movedThisStep{false};
+    bool pairedLastStep{false};
+    CoastState coast;
+
+    std::uint32_t category{layers::all};
+    std::uint32_t mask{layers::all};
+    bool sensor{false}; // reports overlaps but never pushes or is pushed
+
     BallEntity() = default;
 
     void setFrictionColors(const sf::Color& cNF, const sf::Color& cF) {
@@ -80,14 +265,18 @@ struct BallEntity {
         ball.setOrigin(radius,radius);
         ball.setRadius(radius);
         ball.setPosition(x, y);
+        anchor = {x, y};
         ball.setFillColor(frictionEnabled ? colorFriction : colorNoFriction);
     }
 
-    void moveEntity(const sf::Vector2f& acceleration, float delta, bool frictionEnabled = false) {
+    // acceleration is applied as is; spring_stiffness pulls the body back toward its anchor
+    template <typename Integrator = DefaultIntegrator>
+    void moveEntity(const sf::Vector2f& acceleration, float delta, bool frictionEnabled = false, float spring_stiffness = 0.f) {
         sf::Vector2f nVelocity = velocity;
         sf::Vector2f pos = ball.getPosition();
-        pos += acceleration * 0.5f * delta * delta + nVelocity * delta;
-        nVelocity += acceleration * delta;
+        Integrator::step(pos, nVelocity, delta, [&](const sf::Vector2f& p) {
+            return acceleration - (p - anchor) * spring_stiffness;
+        });
         ball.setPosition(pos);
 
         float nVMag = std::hypot(nVelocity.x, nVelocity.y);
@@ -95,7 +284,7 @@ struct BallEntity {
             ball.setFillColor(colorFriction);
             if (std::fabs(nVMag) > epsilon) {
                 sf::Vector2f nVNorm = nVelocity / nVMag;
-                nVMag = std::max(0.f, nVMag - material.friction * delta);
+                nVMag = std::max(0.f, nVMag - materials.friction[materialId] * delta);
                 nVelocity = nVNorm * nVMag;
             }
         } else {
@@ -109,6 +298,12 @@ struct BallEntity {
         }
     }
 
+    bool overlaps(const BallEntity& other) const {
+        sf::Vector2f difference_vector = other.ball.getPosition() - ball.getPosition();
+        float reach = radius + other.radius;
+        return dot(difference_vector, difference_vector) < reach * reach;
+    }
+
     // this WILL change the other entity
     // if you don't like this, do another kind of collision resolution
     bool collisionWith(BallEntity& other) {
@@ -125,31 +320,22 @@ struct BallEntity {
         }
 
         if (interpenetration_dist > epsilon) { // touching
-            // resolve interpenetration
-            ball.move(-collision_normal * interpenetration_dist);
-
-            sf::Vector2f vAB = velocity - other.velocity;
-            sf::Vector2f vBA = -vAB;
-
-            float sum_massriprocals = 1.f/material.mass + 1.f/other.material.mass;
+            // resolve interpenetration, split by inverse mass so static bodies stay put
+            float share = materials.pushShare[materialId][other.materialId];
+            float other_share = materials.pushShare[other.materialId][materialId];
+            ball.move(-collision_normal * (interpenetration_dist * share));
+            other.ball.move(collision_normal * (interpenetration_dist * other_share));
+            movedThisStep |= share > 0.f;
+            other.movedThisStep |= other_share > 0.f;
+            assert(materials.inverseMass[materialId] > 0.f || ball.getPosition() == this_entity);
+            assert(materials.inverseMass[other.materialId] > 0.f || other.ball.getPosition() == other_entity);
 
             // note: the "elasticity" is also known as the coefficient of restitution
             // different physics engines may choose to modify this depending on the situation
-            float this_impulse = -(((1 + material.elasticity) * dot(vAB, collision_normal)) / sum_massriprocals);
-            float other_impulse = -(((1 + other.material.elasticity) * dot(vBA, collision_normal)) / sum_massriprocals);
-
-            sf::Vector2f this_new_velocity;
-            if (std::fabs(material.mass) > epsilon) {
-                this_new_velocity = velocity + collision_normal * (this_impulse / material.mass);
-            }
-
-            sf::Vector2f other_new_velocity;
-            if (std::fabs(other.material.mass) > epsilon) {
-                other_new_velocity = other.velocity + collision_normal * (other_impulse / other.material.mass);
-            }
-
-            velocity = this_new_velocity;
-            other.velocity = other_new_velocity;
+            // static bodies have an inverse mass of 0, so their gain is 0 and they keep their velocity
+            float approach_speed = dot(velocity - other.velocity, collision_normal);
+            velocity -= collision_normal * (approach_speed * materials.velocityGain[materialId][other.materialId]);
+            other.velocity += collision_normal * (approach_speed * materials.velocityGain[other.materialId][materialId]);
             return true;
         } else {
             return false;
@@ -157,31 +343,38 @@ struct BallEntity {
     }
 
     // snapping; can't think of a better way
-    void wallBounce(float x_bound, float y_bound) {
+    // returns true if any wall was touched
+    bool wallBounce(float x_bound, float y_bound) {
         sf::Vector2f tempPosition = ball.getPosition();
+        bool touched = false;
         if (tempPosition.x - radius < 0) {
             ball.setPosition(radius, tempPosition.y);
             tempPosition.x = radius;
-            velocity.x *= -material.elasticity;
+            velocity.x *= -materials.elasticity[materialId];
+            touched = true;
         }
 
         if (tempPosition.y - radius < 0) {
             ball.setPosition(tempPosition.x, radius);
             tempPosition.y = radius;
-            velocity.y *= -material.elasticity;
+            velocity.y *= -materials.elasticity[materialId];
+            touched = true;
         }
 
         if (tempPosition.x + radius > x_bound) {
             ball.setPosition(x_bound - radius, tempPosition.y);
             tempPosition.x = x_bound - radius;
-            velocity.x *= -material.elasticity;
+            velocity.x *= -materials.elasticity[materialId];
+            touched = true;
         }
 
         if (tempPosition.y + radius > y_bound) {
             ball.setPosition(tempPosition.x, y_bound - radius);
             tempPosition.y = y_bound - radius;
-            velocity.y *= -material.elasticity;
+            velocity.y *= -materials.elasticity[materialId];
+            touched = true;
         }
+        return touched;
     }
 };
 
@@ -191,31 +384,636 @@ enum Direction {up, down, left, right};
 // globals
 unsigned int window_w{default_vals::window_w};
 unsigned int window_h{default_vals::window_h};
+unsigned int arena_w{default_vals::window_w};
+unsigned int arena_h{default_vals::window_h};
 float force{default_vals::force};
 unsigned int num_circles{default_vals::num_circles};
 
 bool directionFlags[4] = {false, false, false, false};
 bool leftMouseButtonFlag = false;
 bool gfrictionEnabled = false;
+bool multiRateEnabled = true;
 
 BallEntity userBallEntity;
+Material user_material{default_vals::user::mass, default_vals::user::elasticity, default_vals::user::friction};
 Material enemy_material{default_vals::enemy::mass, default_vals::enemy::elasticity, default_vals::enemy::friction};
 float enemy_radius{default_vals::enemy::radius};
+float enemy_radius_max{default_vals::enemy::radius};
+unsigned int scene_seed{0}; // 0 picks one from the clock
+bool enemyVsEnemy{true};
+float spring_stiffness{0.f}; // per unit mass; 0 turns the anchor springs off
+unsigned int num_sensors{0}; // the last num_sensors enemies are sensors
 std::vector<BallEntity> otherBallEntities;
 bool userBallEntityFlag;
 std::vector<bool> otherBallEntitiesFlag;
 
+sf::View camera;
+// draws all the balls in one call
+BallBatchRenderer ballRenderer;
+unsigned long long simulationStep{0};
+
+// enemies are bodies [0, num_circles), the user ball is body num_circles
+BallEntity& bodyAt(unsigned int i) {
+    return i < num_circles ? otherBallEntities[i] : userBallEntity;
+}
+
+// moves a coasting body's shape to where it is after the given step; physics ignores the shape until it wakes
+void syncCoastingPosition(BallEntity& body, unsigned long long lastStep) {
+    if (!body.coast.active) return;
+    const CoastState& coast = body.coast;
+    body.ball.setPosition(coast.origin + coast.direction * coast.distanceAfter(lastStep - coast.startStep));
+}
+
+// turns a coasting body back into a normally stepped one, as of the end of lastStep
+void wakeBody(BallEntity& body, unsigned long long lastStep) {
+    if (!body.coast.active) return;
+    syncCoastingPosition(body, lastStep);
+    body.velocity = body.coast.direction * body.coast.speedAfter(lastStep - body.coast.startStep);
+    body.coast.active = false;
+    body.pendingDelta = 0.f;
+    body.movedThisStep = true;
+}
+
+// starts closed-form coasting from the body's state at the end of this step
+// the body is woken when a broadphase pair involves its path, or a step before it would reach a wall
+bool beginCoast(BallEntity& body, float delta, bool frictionEnabled) {
+    CoastState& coast = body.coast;
+    sf::Vector2f pos = body.ball.getPosition();
+    float speed = std::hypot(body.velocity.x, body.velocity.y);
+    coast.friction = frictionEnabled;
+    coast.delta = delta;
+    coast.origin = pos;
+    coast.speed = speed;
+    coast.direction = speed > epsilon ? body.velocity / speed : zero_vector;
+    coast.slowdown = frictionEnabled ? materials.friction[body.materialId] * delta : 0.f;
+    bool stops = coast.slowdown > 0.f;
+    coast.movingSteps = speed > epsilon && stops
+        ? static_cast<unsigned long long>(std::ceil((speed - epsilon) / coast.slowdown)) : 0;
+
+    // how far it can go along its direction before touching a wall
+    float wallDist = std::numeric_limits<float>::max();
+    sf::Vector2f dir = coast.direction;
+    if (dir.x > epsilon) wallDist = std::min(wallDist, (arena_w - body.radius - pos.x) / dir.x);
+    if (dir.x < -epsilon) wallDist = std::min(wallDist, (body.radius - pos.x) / dir.x);
+    if (dir.y > epsilon) wallDist = std::min(wallDist, (arena_h - body.radius - pos.y) / dir.y);
+    if (dir.y < -epsilon) wallDist = std::min(wallDist, (body.radius - pos.y) / dir.y);
+    wallDist = std::max(wallDist, 0.f);
+
+    float travel;
+    coast.wakeStep = std::numeric_limits<unsigned long long>::max();
+    if (speed <= epsilon) {
+        travel = 0.f;
+    } else if (stops && coast.distanceAfter(coast.movingSteps) <= wallDist) {
+        travel = coast.distanceAfter(coast.movingSteps);
+    } else {
+        // first step count that ends past the wall
+        unsigned long long lo = 0;
+        unsigned long long hi = stops ? coast.movingSteps
+            : static_cast<unsigned long long>(wallDist / (speed * delta)) + 2;
+        while (hi - lo > 1) {
+            unsigned long long mid = lo + (hi - lo) / 2;
+            if (coast.distanceAfter(mid) > wallDist) hi = mid; else lo = mid;
+        }
+        if (hi <= 2) return false; // about to bounce anyway
+        coast.wakeStep = simulationStep + hi;
+        travel = wallDist;
+    }
+
+    sf::Vector2f end = pos + dir * travel;
+    coast.bounds.left = std::min(pos.x, end.x) - body.radius;
+    coast.bounds.top = std::min(pos.y, end.y) - body.radius;
+    coast.bounds.width = std::fabs(end.x - pos.x) + 2 * body.radius;
+    coast.bounds.height = std::fabs(end.y - pos.y) + 2 * body.radius;
+    coast.startStep = simulationStep;
+    coast.active = true;
+    return true;
+}
+
+// sort and sweep along x
+// the order barely changes between steps, so the insertion sort is close to linear
+struct BodyPair {
+    unsigned int first;
+    unsigned int second;
+};
+
+// a body overlapping a trigger zone
+struct TriggerPair {
+    unsigned int trigger;
+    unsigned int body;
+};
+
+// proxies [0, bodyCount) are bodies, the rest are trigger zones with fixed bounds
+struct SweepAndPrune {
+    unsigned int bodyCount{0};
+    std::vector<unsigned int> order;
+    std::vector<float> lowX;
+    std::vector<float> highX;
+    std::vector<float> lowY;
+    std::vector<float> highY;
+    std::vector<std::uint32_t> categories;
+    std::vector<std::uint32_t> masks;
+    std::vector<BodyPair> pairs; // reused between steps
+    std::vector<TriggerPair> triggerPairs;
+
+    void resize(unsigned int bodies, unsigned int triggers) {
+        bodyCount = bodies;
+        unsigned int count = bodies + triggers;
+        order.resize(count);
+        std::iota(order.begin(), order.end(), 0);
+        lowX.resize(count);
+        highX.resize(count);
+        lowY.resize(count);
+        highY.resize(count);
+        categories.resize(count);
+        masks.resize(count);
+    }
+
+    void setTrigger(unsigned int t, const sf::FloatRect& bounds, std::uint32_t category, std::uint32_t mask) {
+        unsigned int i = bodyCount + t;
+        lowX[i] = bounds.left;
+        highX[i] = bounds.left + bounds.width;
+        lowY[i] = bounds.top;
+        highY[i] = bounds.top + bounds.height;
+        categories[i] = category;
+        masks[i] = mask;
+    }
+
+    // collects every pair whose bounding boxes, grown by margin, overlap
+    // and whose layers accept each other; coasting bodies use their whole path
+    void findPairs(float margin) {
+        pairs.clear();
+        triggerPairs.clear();
+        unsigned int count = order.size();
+        for (unsigned int i = 0; i < bodyCount; ++i) {
+            BallEntity& body = bodyAt(i);
+            if (body.coast.active) {
+                const sf::FloatRect& path = body.coast.bounds;
+                lowX[i] = path.left - margin;
+                highX[i] = path.left + path.width + margin;
+                lowY[i] = path.top - margin;
+                highY[i] = path.top + path.height + margin;
+            } else {
+                sf::Vector2f pos = body.ball.getPosition();
+                float reach = body.radius + margin;
+                lowX[i] = pos.x - reach;
+                highX[i] = pos.x + reach;
+                lowY[i] = pos.y - reach;
+                highY[i] = pos.y + reach;
+            }
+            categories[i] = body.category;
+            masks[i] = body.mask;
+        }
+        for (unsigned int a = 1; a < count; ++a) {
+            unsigned int key = order[a];
+            unsigned int b = a;
+            for (; b > 0 && lowX[order[b-1]] > lowX[key]; --b) {
+                order[b] = order[b-1];
+            }
+            order[b] = key;
+        }
+        for (unsigned int a = 0; a < count; ++a) {
+            unsigned int i = order[a];
+            float firstHighX = highX[i];
+            std::uint32_t firstCategory = categories[i];
+            std::uint32_t firstMask = masks[i];
+            for (unsigned int b = a + 1; b < count && lowX[order[b]] <= firstHighX; ++b) {
+                unsigned int j = order[b];
+                if (!(firstMask & categories[j]) || !(masks[j] & firstCategory)) continue;
+                if (lowY[j] > highY[i] || lowY[i] > highY[j]) continue;
+                // trigger masks never include layers::trigger, so at most one side is a trigger
+                if (i >= bodyCount) {
+                    triggerPairs.push_back({i - bodyCount, j});
+                } else if (j >= bodyCount) {
+                    triggerPairs.push_back({j - bodyCount, i});
+                } else {
+                    pairs.push_back({i, j});
+                }
+            }
+        }
+    }
+};
+
+SweepAndPrune broadPhase;
+std::vector<BodyPair> sensorOverlaps; // refilled every step
+
+// zones that report balls entering and leaving
+struct TriggerZone {
+    std::string name;
+    sf::FloatRect bounds;
+    std::uint32_t mask;
+    unsigned int occupants{0};
+    sf::RectangleShape shape;
+};
+
+struct TriggerEvent {
+    unsigned int trigger;
+    unsigned int body;
+    bool entered;
+};
+
+std::vector<TriggerZone> triggerZones;
+// trigger in the high half, body in the low half; kept sorted so steps can be diffed with a merge
+std::vector<std::uint64_t> triggerOverlaps;
+std::vector<std::uint64_t> previousTriggerOverlaps;
+std::vector<TriggerEvent> triggerEvents; // refilled every step
+
+bool readTriggerZones() {
+    std::ifstream zones("hw06_triggers.txt");
+    if (!zones.is_open()) return false;
+    TriggerZone zone;
+    while (zones >> zone.name >> zone.bounds.left >> zone.bounds.top >> zone.bounds.width >> zone.bounds.height >> zone.mask) {
+        triggerZones.push_back(zone);
+    }
+    return true;
+}
+
+bool circleOverlapsRect(const sf::Vector2f& center, float radius, const sf::FloatRect& rect) {
+    sf::Vector2f closest{
+        utility::clamp(center.x, rect.left, rect.left + rect.width),
+        utility::clamp(center.y, rect.top, rect.top + rect.height)};
+    sf::Vector2f difference_vector = center - closest;
+    return dot(difference_vector, difference_vector) < radius * radius;
+}
+
+// keeps the body-zone pairs that really overlap, then merges against the last step's
+// sorted set so only the changes come out as events
+void updateTriggerOverlaps() {
+    std::swap(triggerOverlaps, previousTriggerOverlaps);
+    triggerOverlaps.clear();
+    for (const TriggerPair& pair : broadPhase.triggerPairs) {
+        BallEntity& body = bodyAt(pair.body);
+        syncCoastingPosition(body, simulationStep);
+        if (circleOverlapsRect(body.ball.getPosition(), body.radius, triggerZones[pair.trigger].bounds)) {
+            triggerOverlaps.push_back(static_cast<std::uint64_t>(pair.trigger) << 32 | pair.body);
+        }
+    }
+    std::sort(triggerOverlaps.begin(), triggerOverlaps.end());
+
+    triggerEvents.clear();
+    auto emit = [](std::uint64_t key, bool entered) {
+        triggerEvents.push_back({static_cast<unsigned int>(key >> 32), static_cast<unsigned int>(key & 0xFFFFFFFFu), entered});
+    };
+    std::size_t cur = 0;
+    std::size_t prev = 0;
+    while (cur < triggerOverlaps.size() || prev < previousTriggerOverlaps.size()) {
+        if (prev == previousTriggerOverlaps.size() ||
+            (cur < triggerOverlaps.size() && triggerOverlaps[cur] < previousTriggerOverlaps[prev])) {
+            emit(triggerOverlaps[cur++], true);
+        } else if (cur == triggerOverlaps.size() || previousTriggerOverlaps[prev] < triggerOverlaps[cur]) {
+            emit(previousTriggerOverlaps[prev++], false);
+        } else {
+            ++cur;
+            ++prev;
+        }
+    }
+}
+
+void handleTriggerEvents() {
+    for (const TriggerEvent& event : triggerEvents) {
+        TriggerZone& zone = triggerZones[event.trigger];
+        if (event.entered) {
+            ++zone.occupants;
+        } else {
+            --zone.occupants;
+        }
+        zone.shape.setFillColor(zone.occupants > 0 ? sf::Color(255, 255, 255, 96) : sf::Color(255, 255, 255, 32));
+        // outlined while the user ball is inside
+        if (event.body == num_circles) {
+            zone.shape.setOutlineThickness(event.entered ? 2.f : 0.f);
+        }
+    }
+}
+
+// per-step physics counters; compile with -DPHYSICS_STATS to collect them
+// G toggles the on-screen graph, P dumps the history to hw06_stats.csv
+#ifdef PHYSICS_STATS
+struct StepStats {
+    unsigned long long step{0};
+    unsigned int bodiesIntegrated{0};
+    unsigned int bodiesCoasting{0};
+    unsigned int wakeUps{0};
+    unsigned int candidatePairs{0};
+    unsigned int narrowPhaseTests{0};
+    unsigned int contacts{0};
+    unsigned int sensorOverlaps{0};
+    unsigned int wallContacts{0};
+    unsigned int solverIterations{0}; // always 1: the solver makes one sequential pass over the pairs
+    sf::Int64 integrateMicros{0};
+    sf::Int64 broadPhaseMicros{0};
+    sf::Int64 triggerMicros{0}; // zone overlaps and their enter/exit events
+    sf::Int64 solveMicros{0};
+};
+
+// fixed-size ring of the most recent steps
+struct PhysicsStatsHistory {
+    static constexpr unsigned int capacity{600};
+    std::array<StepStats, capacity> ring;
+    unsigned int head{0}; // next slot to write
+    unsigned int size{0};
+    StepStats current;
+    sf::Clock phaseClock;
+    bool showGraph{false};
+    sf::Font font;
+    bool fontLoaded{false};
+
+    void beginStep(unsigned long long step) {
+        current = StepStats();
+        current.step = step;
+        phaseClock.restart();
+    }
+
+    void endPhase(sf::Int64& micros) {
+        micros += phaseClock.restart().asMicroseconds();
+    }
+
+    void endStep() {
+        ring[head] = current;
+        head = (head + 1) % capacity;
+        size = std::min(size + 1, capacity);
+    }
+
+    // i = 0 is the oldest step kept
+    const StepStats& at(unsigned int i) const {
+        return ring[(head + capacity - size + i) % capacity];
+    }
+
+    bool writeCsv(const std::string& fileName) const {
+        std::ofstream csv(fileName);
+        if (!csv.is_open()) return false;
+        csv << "step,bodies_integrated,bodies_coasting,wake_ups,candidate_pairs,narrow_phase_tests,contacts,sensor_overlaps,wall_contacts,solver_iterations,integrate_us,broadphase_us,trigger_us,solve_us\n";
+        for (unsigned int i = 0; i < size; ++i) {
+            const StepStats& st = at(i);
+            csv << st.step << ',' << st.bodiesIntegrated << ',' << st.bodiesCoasting << ','
+                << st.wakeUps << ',' << st.candidatePairs << ','
+                << st.narrowPhaseTests << ',' << st.contacts << ',' << st.sensorOverlaps << ','
+                << st.wallContacts << ',' << st.solverIterations << ',' << st.integrateMicros << ','
+                << st.broadPhaseMicros << ',' << st.triggerMicros << ',' << st.solveMicros << '\n';
+        }
+        return true;
+    }
+
+    // stacked bars of the phase times, one pixel column per step; the line marks one fixed update
+    void draw(sf::RenderWindow& window) {
+        if (!showGraph || size == 0) return;
+        window.setView(window.getDefaultView());
+        constexpr float graph_h{150.f};
+        float pxPerMicro = graph_h / fixed_update_time.asMicroseconds();
+        float baseY = window_h - 10.f;
+        sf::VertexArray bars(sf::Quads);
+        auto addBar = [&](float x, float y0, float h, const sf::Color& c) {
+            bars.append(sf::Vertex({x, y0}, c));
+            bars.append(sf::Vertex({x + 1.f, y0}, c));
+            bars.append(sf::Vertex({x + 1.f, y0 - h}, c));
+            bars.append(sf::Vertex({x, y0 - h}, c));
+        };
+        for (unsigned int i = 0; i < size; ++i) {
+            const StepStats& st = at(i);
+            float x = 10.f + i;
+            float y = baseY;
+            float h = st.integrateMicros * pxPerMicro;
+            addBar(x, y, h, sf::Color::Green);
+            y -= h;
+            h = st.broadPhaseMicros * pxPerMicro;
+            addBar(x, y, h, sf::Color::Yellow);
+            y -= h;
+            h = st.triggerMicros * pxPerMicro;
+            addBar(x, y, h, sf::Color::Cyan);
+            y -= h;
+            addBar(x, y, st.solveMicros * pxPerMicro, sf::Color::Red);
+        }
+        sf::VertexArray budget(sf::Lines, 2);
+        budget[0] = sf::Vertex({10.f, baseY - graph_h}, sf::Color::White);
+        budget[1] = sf::Vertex({10.f + capacity, baseY - graph_h}, sf::Color::White);
+        window.draw(bars);
+        window.draw(budget);
+
+        if (!fontLoaded) return;
+        const StepStats& st = at(size - 1);
+        sf::Text text;
+        text.setFont(font);
+        text.setCharacterSize(14);
+        text.setString(
+            "integrated: " + std::to_string(st.bodiesIntegrated) +
+            "  coasting: " + std::to_string(st.bodiesCoasting) +
+            "  woken: " + std::to_string(st.wakeUps) +
+            "  pairs: " + std::to_string(st.candidatePairs) +
+            "  tested: " + std::to_string(st.narrowPhaseTests) +
+            "  contacts: " + std::to_string(st.contacts) +
+            "  sensors: " + std::to_string(st.sensorOverlaps) +
+            "  walls: " + std::to_string(st.wallContacts) +
+            "  solver passes: " + std::to_string(st.solverIterations) +
+            "\nintegrate " + std::to_string(st.integrateMicros) +
+            "us  broadphase " + std::to_string(st.broadPhaseMicros) +
+            "us  triggers " + std::to_string(st.triggerMicros) +
+            "us  solve " + std::to_string(st.solveMicros) + "us"
+            );
+        text.setPosition(10.f, baseY - graph_h - 40.f);
+        window.draw(text);
+    }
+};
+
+PhysicsStatsHistory physicsStats;
+
+#define PHYSICS_STAT_ADD(field, n) (physicsStats.current.field += (n))
+#define PHYSICS_STAT_PHASE(field) physicsStats.endPhase(physicsStats.current.field)
+#else
+#define PHYSICS_STAT_ADD(field, n) ((void)0)
+#define PHYSICS_STAT_PHASE(field) ((void)0)
+#endif
+
+void updateCamera() {
+    sf::Vector2f half{window_w / 2.f, window_h / 2.f};
+    sf::Vector2f center = userBallEntity.ball.getPosition();
+    center.x = arena_w > window_w ? utility::clamp(center.x, half.x, arena_w - half.x) : arena_w / 2.f;
+    center.y = arena_h > window_h ? utility::clamp(center.y, half.y, arena_h - half.y) : arena_h / 2.f;
+    camera.setCenter(center);
+}
+
+struct SceneBall {
+    sf::Vector2f position;
+    float radius;
+};
+
+// Bridson's Poisson-disk sampling on a background grid with one point per cell,
+// trying candidates at evenly spaced angles just past the minimum distance (Roberts' variant)
+// centers end up at least 2 * max_radius apart, so any radius in [min_radius, max_radius] fits
+// the same seed always gives the same scene; stops as soon as count balls are placed
+std::vector<SceneBall> generatePoissonScene(unsigned int count, float min_radius, float max_radius,
+        float width, float height, unsigned int seed,
+        const sf::Vector2f& keepClear, float keepClearRadius) {
+    std::vector<SceneBall> balls;
+    float minDist = 2 * max_radius;
+    float innerW = width - 2 * max_radius;
+    float innerH = height - 2 * max_radius;
+    if (count == 0 || innerW <= 0 || innerH <= 0) return balls;
+    balls.reserve(count);
+
+    float cellSize = minDist / std::sqrt(2.f);
+    float invCellSize = 1.f / cellSize;
+    // three cells of padding on every side so neighbour lookups need no bounds checks
+    int gridW = static_cast<int>(std::ceil(innerW * invCellSize)) + 6;
+    int gridH = static_cast<int>(std::ceil(innerH * invCellSize)) + 6;
+    // each cell keeps its point's position so lookups stay inside the grid; empty cells are far away
+    const sf::Vector2f empty_cell{-1e30f, -1e30f};
+    std::vector<sf::Vector2f> grid(static_cast<std::size_t>(gridW) * gridH, empty_cell);
+    // every candidate is just over minDist from its origin, so anything that can reject it
+    // is within about 2 * minDist of the origin, in the 7x7 cells around the origin's.
+    // those are read once per attempt instead of once per candidate
+    int neighbours[49];
+    unsigned int neighbourCount = 0;
+    for (int dy = -3; dy <= 3; ++dy) {
+        for (int dx = -3; dx <= 3; ++dx) {
+            neighbours[neighbourCount++] = dy * gridW + dx;
+        }
+    }
+    std::vector<sf::Vector2f> active;
+
+    // a plain LCG with our own float conversion keeps scenes identical across standard libraries
+    std::minstd_rand gen(seed);
+    auto unit = [&gen]() {
+        return (gen() - 1) * (1.f / 2147483646.f);
+    };
+
+    float minDistSq = minDist * minDist;
+    float clearDist = keepClearRadius + max_radius;
+    float clearDistSq = clearDist * clearDist;
+    sf::Vector2f clearCenter = keepClear - sf::Vector2f(max_radius, max_radius);
+    auto cellOf = [&](float x, float y) {
+        return (static_cast<int>(y * invCellSize) + 3) * gridW + static_cast<int>(x * invCellSize) + 3;
+    };
+    // inside the inner rectangle and out of the kept-clear area
+    auto allowed = [&](float x, float y) {
+        if (x < 0 || y < 0 || x >= innerW || y >= innerH) return false;
+        float cdx = x - clearCenter.x;
+        float cdy = y - clearCenter.y;
+        return cdx * cdx + cdy * cdy >= clearDistSq;
+    };
+    // positions inside the inner rectangle, shifted by max_radius when stored
+    auto insert = [&](float x, float y) {
+        grid[cellOf(x, y)] = {x, y};
+        active.push_back({x, y});
+        float r = min_radius + (max_radius - min_radius) * unit();
+        balls.push_back({{x + max_radius, y + max_radius}, r});
+    };
+
+    // the first point may land in the kept-clear area, so give it a few tries
+    for (unsigned int tries = 0; tries < 64 && balls.empty(); ++tries) {
+        // y first, the order g++ drew them in before, so logged seeds keep their scenes
+        float y = unit() * innerH;
+        float x = unit() * innerW;
+        if (allowed(x, y)) insert(x, y);
+    }
+
+    // evenly spaced candidate offsets on the ring, rotated by a random angle per attempt
+    constexpr unsigned int k{default_vals::scene::candidates_per_point};
+    float ringDist = minDist * 1.0001f;
+    sf::Vector2f ring[k];
+    for (unsigned int j = 0; j < k; ++j) {
+        ring[j] = {ringDist * std::cos(2 * pi * j / k), ringDist * std::sin(2 * pi * j / k)};
+    }
+    // the points near the origin, and every candidate of an attempt tested against all of
+    // them with no early exits; the first one that passes is the one the sequential
+    // test would have taken, since nothing is inserted until then
+    // with a little slack: a hundred thousand px out, positions are only good to about 0.01 px
+    float reach = (ringDist + minDist) * 1.01f;
+    float reachSq = reach * reach;
+    float nearX[49], nearY[49];
+    float candX[k], candY[k];
+    int openSlots[k];
+    while (!active.empty() && balls.size() < count) {
+        unsigned int slot = gen() % active.size();
+        sf::Vector2f origin = active[slot];
+        float angle = unit() * 2 * pi / k;
+        float c = std::cos(angle);
+        float sn = std::sin(angle);
+
+        int originCell = cellOf(origin.x, origin.y);
+        unsigned int nearbyCount = 0;
+        for (unsigned int n = 0; n < neighbourCount; ++n) {
+            const sf::Vector2f& other = grid[originCell + neighbours[n]];
+            float dx = other.x - origin.x;
+            float dy = other.y - origin.y;
+            nearX[nearbyCount] = other.x;
+            nearY[nearbyCount] = other.y;
+            nearbyCount += dx * dx + dy * dy < reachSq;
+        }
+        for (unsigned int j = 0; j < k; ++j) {
+            float x = origin.x + c * ring[j].x - sn * ring[j].y;
+            float y = origin.y + sn * ring[j].x + c * ring[j].y;
+            float cdx = x - clearCenter.x;
+            float cdy = y - clearCenter.y;
+            candX[j] = x;
+            candY[j] = y;
+            openSlots[j] = (x >= 0) & (y >= 0) & (x < innerW) & (y < innerH) & (cdx * cdx + cdy * cdy >= clearDistSq);
+        }
+        for (unsigned int n = 0; n < nearbyCount; ++n) {
+            for (unsigned int j = 0; j < k; ++j) {
+                float dx = nearX[n] - candX[j];
+                float dy = nearY[n] - candY[j];
+                openSlots[j] &= dx * dx + dy * dy >= minDistSq;
+            }
+        }
+        unsigned int first = std::find(openSlots, openSlots + k, 1) - openSlots;
+        bool placed = first < k;
+        if (placed) insert(candX[first], candY[first]);
+        if (!placed) {
+            active[slot] = active.back();
+            active.pop_back();
+        }
+    }
+    return balls;
+}
+
+// sets the masks for the current mode; filtered pairs never leave the broadphase
+void applyCollisionMode() {
+    userBallEntity.category = layers::user;
+    userBallEntity.mask = layers::all;
+    for (BallEntity& enemy : otherBallEntities) {
+        enemy.category = layers::enemy;
+        enemy.mask = enemyVsEnemy ? layers::all : layers::all & ~layers::enemy;
+    }
+}
+
 bool readFromAvailableText() {
     std::string input;
     std::ifstream settings("hw06_settings.txt");
     if (settings.is_open()) {
         settings >> window_w >> window_h;
         settings >> force;
-        settings >> userBallEntity.material.mass >> userBallEntity.material.elasticity >> userBallEntity.material.friction;
+        settings >> user_material.mass >> user_material.elasticity >> user_material.friction;
         settings >> userBallEntity.radius;
         settings >> num_circles;
         settings >> enemy_material.mass >> enemy_material.elasticity >> enemy_material.friction;
         settings >> enemy_radius;
+        // optional; the arena is the window unless stated otherwise
+        unsigned int aw, ah;
+        if (settings >> aw >> ah) {
+            arena_w = aw;
+            arena_h = ah;
+        } else {
+            arena_w = window_w;
+            arena_h = window_h;
+        }
+        // optional; enemy radii are drawn from [enemy_radius, enemy_radius_max]
+        float rmax;
+        unsigned int seed;
+        if (settings >> rmax >> seed) {
+            enemy_radius_max = std::max(rmax, enemy_radius);
+            scene_seed = seed;
+        } else {
+            enemy_radius_max = enemy_radius;
+        }
+        // optional; collision mode
+        unsigned int eve, sensors;
+        if (settings >> eve >> sensors) {
+            enemyVsEnemy = eve != 0;
+            num_sensors = sensors;
+        }
+        // optional; springs tying enemies to their spawn points
+        float stiffness;
+        if (settings >> stiffness) {
+            spring_stiffness = stiffness;
+        }
         settings.close();
         return true;
     } else {
@@ -223,33 +1021,91 @@ bool readFromAvailableText() {
     }
 }
 
+// grows the arena until count enemies fit around the user's start
+std::vector<SceneBall> placeEnemies(unsigned int count, sf::Vector2f& userStart) {
+    float spacing = 2 * enemy_radius_max;
+    float neededArea = count * spacing * spacing / default_vals::scene::expected_density;
+    if (static_cast<float>(arena_w) * arena_h < neededArea) {
+        float scale = std::sqrt(neededArea / (static_cast<float>(arena_w) * arena_h));
+        arena_w = static_cast<unsigned int>(std::ceil(arena_w * scale));
+        arena_h = static_cast<unsigned int>(std::ceil(arena_h * scale));
+    }
+    std::vector<SceneBall> scene;
+    while (true) {
+        userStart = {arena_w / 2.f, arena_h - userBallEntity.radius};
+        scene = generatePoissonScene(count, enemy_radius, enemy_radius_max,
+            arena_w, arena_h, scene_seed, userStart, userBallEntity.radius);
+        if (scene.size() >= count) break;
+        arena_w = static_cast<unsigned int>(std::ceil(arena_w * default_vals::scene::arena_growth));
+        arena_h = static_cast<unsigned int>(std::ceil(arena_h * default_vals::scene::arena_growth));
+    }
+    std::cout << "arena: " << arena_w << "x" << arena_h << "\n";
+    return scene;
+}
+
 void initializeSettings() {
     if (readFromAvailableText()) {
         std::cout << "hw06_settings.txt successfully loaded.\n";
     } else {
         std::cout << "hw06_settings.txt not loaded. Using default values.\n";
-        userBallEntity.material = {default_vals::user::mass, default_vals::user::elasticity, default_vals::user::friction};
+        user_material = {default_vals::user::mass, default_vals::user::elasticity, default_vals::user::friction};
         userBallEntity.radius = default_vals::user::radius;
         userBallEntity.setFrictionColors(sf::Color::Green, sf::Color::Red);
+        arena_w = window_w;
+        arena_h = window_h;
+    }
+
+    materials.clear();
+    userBallEntity.materialId = materials.add(user_material);
+    MaterialId enemy_material_id = materials.add(enemy_material);
+
+    if (scene_seed == 0) {
+        scene_seed = static_cast<unsigned int>(time(NULL));
     }
+    std::cout << "scene seed: " << scene_seed << "\n";
+
+    sf::Vector2f userStart;
+    std::vector<SceneBall> scene = placeEnemies(num_circles, userStart);
 
+    otherBallEntities.clear();
     otherBallEntities.resize(num_circles);
-    float borderX = window_w - 4 * enemy_radius;
-    float borderY = window_h - 2 * userBallEntity.radius - 4 * enemy_radius;
     for (int i = 0; i < num_circles; ++i) {
-        int row = i / 7;
-        int column = i % 7;
-        otherBallEntities[i].material = enemy_material;
-        otherBallEntities[i].radius = enemy_radius;
+        otherBallEntities[i].materialId = enemy_material_id;
+        otherBallEntities[i].radius = scene[i].radius;
         otherBallEntities[i].setFrictionColors(sf::Color::Blue, sf::Color::Yellow);
-        otherBallEntities[i].initializeEntity(borderX / 7.f * column + 4 * enemy_radius, borderY / 5.f * row + 2 * enemy_radius, gfrictionEnabled);
+        otherBallEntities[i].sensor = i + num_sensors >= num_circles;
+        if (otherBallEntities[i].sensor) {
+            otherBallEntities[i].setFrictionColors(sf::Color(0, 0, 255, 96), sf::Color(255, 255, 0, 96));
+        }
+        otherBallEntities[i].initializeEntity(scene[i].position.x, scene[i].position.y, gfrictionEnabled);
     }
+    applyCollisionMode();
 
     userBallEntityFlag = true;
     otherBallEntitiesFlag.resize(num_circles);
     std::fill(otherBallEntitiesFlag.begin(), otherBallEntitiesFlag.end(), true);
 
-    userBallEntity.initializeEntity(window_w / 2.f, window_h - userBallEntity.radius, gfrictionEnabled);
+    userBallEntity.initializeEntity(userStart.x, userStart.y, gfrictionEnabled);
+    userBallEntity.velocity = zero_vector;
+    userBallEntity.pendingDelta = 0.f;
+    simulationStep = 0;
+
+    triggerZones.clear();
+    if (readTriggerZones()) {
+        std::cout << "hw06_triggers.txt loaded, " << triggerZones.size() << " zones.\n";
+    }
+    broadPhase.resize(num_circles + 1, triggerZones.size());
+    for (unsigned int t = 0; t < triggerZones.size(); ++t) {
+        TriggerZone& zone = triggerZones[t];
+        zone.shape.setPosition(zone.bounds.left, zone.bounds.top);
+        zone.shape.setSize({zone.bounds.width, zone.bounds.height});
+        zone.shape.setFillColor(sf::Color(255, 255, 255, 32));
+        zone.shape.setOutlineColor(sf::Color::Green);
+        broadPhase.setTrigger(t, zone.bounds, layers::trigger, zone.mask & ~layers::trigger);
+    }
+    triggerOverlaps.clear();
+    camera.setSize(window_w, window_h);
+    updateCamera();
 }
 
 void pressEvents(sf::RenderWindow& window, const sf::Event& event) {
@@ -272,6 +1128,23 @@ void pressEvents(sf::RenderWindow& window, const sf::Event& event) {
         case sf::Keyboard::F:
             gfrictionEnabled = !gfrictionEnabled;
             break;
+        case sf::Keyboard::M:
+            multiRateEnabled = !multiRateEnabled;
+            break;
+        case sf::Keyboard::C:
+            enemyVsEnemy = !enemyVsEnemy;
+            applyCollisionMode();
+            break;
+#ifdef PHYSICS_STATS
+        case sf::Keyboard::G:
+            physicsStats.showGraph = !physicsStats.showGraph;
+            break;
+        case sf::Keyboard::P:
+            if (physicsStats.writeCsv("hw06_stats.csv")) {
+                std::cout << "physics stats written to hw06_stats.csv\n";
+            }
+            break;
+#endif
         default:
             // nothing
             break;
@@ -324,7 +1197,58 @@ void handleInput(sf::RenderWindow& window) {
     }
 }
 
+// full rate on screen or near the user, 1/2 rate a bit farther, 1/4 rate beyond that
+unsigned int distanceTier(const BallEntity& body) {
+    sf::Vector2f pos = body.ball.getPosition();
+    sf::Vector2f center = camera.getCenter();
+    sf::Vector2f half = camera.getSize() / 2.f;
+    float reach = body.radius + default_vals::tiers::screen_margin;
+    if (std::fabs(pos.x - center.x) <= half.x + reach && std::fabs(pos.y - center.y) <= half.y + reach) {
+        return 0;
+    }
+    sf::Vector2f toUser = pos - userBallEntity.ball.getPosition();
+    float dist = std::hypot(toUser.x, toUser.y);
+    if (dist < default_vals::tiers::full_rate_radius) return 0;
+    if (dist < default_vals::tiers::half_rate_radius) return 1;
+    return 2;
+}
+
+void assignRateTiers() {
+    userBallEntity.rateTier = 0;
+    for (unsigned int i = 0; i < num_circles; ++i) {
+        BallEntity& body = otherBallEntities[i];
+        if (body.coast.active) continue;
+        unsigned int tier = multiRateEnabled ? distanceTier(body) : 0;
+        if (body.promotionHold > 0) {
+            --body.promotionHold;
+            tier = std::min(tier, body.rateTier);
+        }
+        body.rateTier = tier;
+    }
+}
+
+// bodies on the same tier are staggered by index so every step does a similar amount of work
+bool isDueThisStep(const BallEntity& body, unsigned int i) {
+    unsigned int stride = 1u << body.rateTier;
+    return ((simulationStep + i) & (stride - 1)) == 0;
+}
+
+// applies all the time a body has banked since it was last stepped
+template <typename Integrator>
+void advanceBody(BallEntity& body, const sf::Vector2f& acceleration) {
+    if (body.pendingDelta <= 0.f) return;
+    float stiffness = &body == &userBallEntity ? 0.f : spring_stiffness;
+    body.moveEntity<Integrator>(acceleration, body.pendingDelta, gfrictionEnabled, stiffness);
+    PHYSICS_STAT_ADD(bodiesIntegrated, 1);
+    if (body.wallBounce(arena_w, arena_h)) {
+        PHYSICS_STAT_ADD(wallContacts, 1);
+    }
+    body.pendingDelta = 0.f;
+    body.movedThisStep = true;
+}
+
 // note: if it's instantaneous acceleration, use a local variable instead
+template <typename Integrator = DefaultIntegrator>
 void update(const sf::Time& elapsed) {
     float delta = elapsed.asSeconds();
 
@@ -336,48 +1260,777 @@ void update(const sf::Time& elapsed) {
     if (directionFlags[static_cast<unsigned int>(Direction::right)]) dir.x += 69.f;
     float dir_mag = std::hypot(dir.x, dir.y);
     if (dir_mag > epsilon) {
-        acceleration = (dir / dir_mag) * force / userBallEntity.material.mass;
+        acceleration = (dir / dir_mag) * force * materials.inverseMass[userBallEntity.materialId];
     }
 
     userBallEntityFlag = false;
     std::fill(otherBallEntitiesFlag.begin(), otherBallEntitiesFlag.end(), false);
 
-    // move first
-    userBallEntity.moveEntity(acceleration, delta, gfrictionEnabled);
-    for (int i = 0; i < num_circles; ++i) {
-        otherBallEntities[i].moveEntity(zero_vector, delta, gfrictionEnabled);
+#ifdef PHYSICS_STATS
+    physicsStats.beginStep(simulationStep);
+#endif
+
+    updateCamera();
+    assignRateTiers();
+
+    // move first; bodies on a slower tier bank their time until their turn comes
+    userBallEntity.movedThisStep = false;
+    userBallEntity.pendingDelta += delta;
+    advanceBody<Integrator>(userBallEntity, acceleration);
+    for (unsigned int i = 0; i < num_circles; ++i) {
+        BallEntity& body = otherBallEntities[i];
+        body.movedThisStep = false;
+        if (body.coast.active) {
+            if (simulationStep < body.coast.wakeStep && body.coast.friction == gfrictionEnabled && body.coast.delta == delta) {
+                PHYSICS_STAT_ADD(bodiesCoasting, 1);
+                continue;
+            }
+            wakeBody(body, simulationStep - 1);
+        }
+        body.pendingDelta += delta;
+        if (isDueThisStep(body, i)) {
+            advanceBody<Integrator>(body, zero_vector);
+        }
+        // nothing near it last step and nothing pushing it: let it slide in closed form
+        if (!body.pairedLastStep && body.pendingDelta == 0.f && spring_stiffness == 0.f) {
+            beginCoast(body, delta, gfrictionEnabled);
+        }
+        body.pairedLastStep = false;
     }
 
+    PHYSICS_STAT_PHASE(integrateMicros);
+
+    broadPhase.findPairs(default_vals::tiers::promotion_margin);
+    PHYSICS_STAT_ADD(candidatePairs, broadPhase.pairs.size());
+    PHYSICS_STAT_PHASE(broadPhaseMicros);
+
+    // zones see the positions the broadphase saw; push-outs below show up next step
+    updateTriggerOverlaps();
+    handleTriggerEvents();
+    PHYSICS_STAT_PHASE(triggerMicros);
+
     // resolve interpenetrations
-    userBallEntity.wallBounce(window_w, window_h);
-    for (int i = 0; i < num_circles; ++i) {
-        otherBallEntities[i].wallBounce(window_w, window_h);
+    // pairs where neither body moved can't have changed since the last check
+    for (const BodyPair& pair : sensorOverlaps) {
+        bodyAt(pair.first).ball.setOutlineThickness(0.f);
+        bodyAt(pair.second).ball.setOutlineThickness(0.f);
     }
+    sensorOverlaps.clear();
+    for (const BodyPair& pair : broadPhase.pairs) {
+        unsigned int i = pair.first;
+        unsigned int j = pair.second;
+        if (j == num_circles) std::swap(i, j); // the user ball resolves its own contacts
+        BallEntity& first = bodyAt(i);
+        BallEntity& second = bodyAt(j);
+        first.pairedLastStep = true;
+        second.pairedLastStep = true;
+        if (first.coast.active || second.coast.active) {
+            PHYSICS_STAT_ADD(wakeUps, first.coast.active + second.coast.active);
+            wakeBody(first, simulationStep);
+            wakeBody(second, simulationStep);
+        }
+        bool sensorPair = first.sensor || second.sensor;
+        if (!first.movedThisStep && !second.movedThisStep && !sensorPair) continue;
 
-    for (int i = 0; i < num_circles; ++i) {
-        for (int j = i+1; j < num_circles; ++j) {
-            if (i == j) continue;
-            otherBallEntities[i].collisionWith(otherBallEntities[j]);
+        // a slower body near a faster one runs at the faster rate for a while,
+        // and is brought up to the present before touching it
+        if (first.rateTier != second.rateTier) {
+            BallEntity& slower = first.rateTier > second.rateTier ? first : second;
+            slower.rateTier = std::min(first.rateTier, second.rateTier);
+            slower.promotionHold = default_vals::tiers::promotion_hold_steps;
+        }
+        advanceBody<Integrator>(first, i == num_circles ? acceleration : zero_vector);
+        advanceBody<Integrator>(second, zero_vector);
+
+        PHYSICS_STAT_ADD(narrowPhaseTests, 1);
+        if (sensorPair) {
+            if (first.overlaps(second)) {
+                sensorOverlaps.push_back({i, j});
+                PHYSICS_STAT_ADD(sensorOverlaps, 1);
+            }
+        } else if (first.collisionWith(second)) {
+            PHYSICS_STAT_ADD(contacts, 1);
         }
-        userBallEntity.collisionWith(otherBallEntities[i]);
     }
+    for (const BodyPair& pair : sensorOverlaps) {
+        BallEntity& sensor = bodyAt(pair.first).sensor ? bodyAt(pair.first) : bodyAt(pair.second);
+        sensor.ball.setOutlineColor(sf::Color::White);
+        sensor.ball.setOutlineThickness(2.f);
+    }
+    PHYSICS_STAT_ADD(solverIterations, 1);
+    PHYSICS_STAT_PHASE(solveMicros);
+
+#ifdef PHYSICS_STATS
+    physicsStats.endStep();
+#endif
+
+    ++simulationStep;
 }
 
 void render(sf::RenderWindow& window) {
     window.clear(sf::Color::Black);
-    window.draw(userBallEntity.ball);
-    for (int i = 0; i < num_circles; ++i) {
-        window.draw(otherBallEntities[i].ball);
+    window.setView(camera);
+    for (const TriggerZone& zone : triggerZones) {
+        window.draw(zone.shape);
+    }
+    // every ball in one draw call; outlined sensors still draw as shapes, on top
+    ballRenderer.clear();
+    ballRenderer.add(userBallEntity.ball);
+    for (unsigned int i = 0; i < num_circles; ++i) {
+        syncCoastingPosition(otherBallEntities[i], simulationStep - 1);
+        if (otherBallEntities[i].ball.getOutlineThickness() <= 0.f) {
+            ballRenderer.add(otherBallEntities[i].ball);
+        }
     }
+    ballRenderer.draw(window);
+    for (unsigned int i = 0; i < num_circles; ++i) {
+        if (otherBallEntities[i].ball.getOutlineThickness() > 0.f) {
+            window.draw(otherBallEntities[i].ball);
+        }
+    }
+#ifdef PHYSICS_STATS
+    physicsStats.draw(window);
+#endif
     window.display();
 }
 
-int main () {
+// compact storage for million-body scenes: bodies are grouped by the 512 px chunk they
+// are in and keep a 16-bit fixed-point offset from its center, so the chunk itself is
+// stored once per group; velocities are half floats and radii are indices into a class
+// table. a step decodes four bodies at a time into SSE registers, steps them with the
+// same kernel as the float layout and encodes them back, so only the compact arrays
+// stream through memory. that halves the bytes per body but adds the decoding, so it
+// only steps faster than the float layout where memory bandwidth is what limits a step
+namespace compact {
+    constexpr float chunk_size{512.f};
+    // offsets reach 512 px either side of the chunk's center
+    constexpr float units_per_pixel{64.f};
+    constexpr std::int32_t chunk_units{static_cast<std::int32_t>(chunk_size * units_per_pixel)};
+    // a body this far from its chunk's center (128 px outside it) has the groups rebuilt;
+    // nothing moves the other 128 px in one step, so offsets never saturate
+    constexpr std::int16_t regroup_units{static_cast<std::int16_t>(3 * chunk_units / 4)};
+    // per axis, so the chunk table stays small
+    constexpr unsigned int max_chunks{4096};
+    constexpr unsigned int radius_classes{256};
+}
+
+// IEEE half <-> float with round to nearest even, after Fabian Giesen's bit tricks
+// https://gist.github.com/rygorous/2156668
+// the store has no use for inf or nan, so anything too big for a half, nan included,
+// saturates at the largest one, 65504
+std::uint16_t floatToHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t sign = bits & 0x80000000u;
+    bits = std::min(bits ^ sign, 0x477FE000u);
+    std::uint32_t half;
+    if (bits < 0x38800000u) {
+        // subnormal half: adding 0.5 lines the mantissa up with the bottom bits and rounds it
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        f += 0.5f;
+        std::memcpy(&bits, &f, sizeof(bits));
+        half = bits - 0x3F000000u;
+    } else {
+        std::uint32_t odd = (bits >> 13) & 1u;
+        // rebias the exponent and round half to even
+        bits += 0xC8000FFFu + odd;
+        half = bits >> 13;
+    }
+    return static_cast<std::uint16_t>(half | (sign >> 16));
+}
+
+float halfToFloat(std::uint16_t half) {
+    constexpr std::uint32_t shifted_exp{0x7C00u << 13};
+    std::uint32_t bits = (half & 0x7FFFu) << 13;
+    std::uint32_t exp = bits & shifted_exp;
+    bits += (127 - 15) << 23;
+    float value;
+    if (exp == shifted_exp) {
+        bits += (128 - 16) << 23;
+        std::memcpy(&value, &bits, sizeof(value));
+    } else if (exp == 0) {
+        // subnormal: renormalize through the FPU
+        bits += 1 << 23;
+        std::memcpy(&value, &bits, sizeof(value));
+        value -= 6.10351562e-05f;
+    } else {
+        std::memcpy(&value, &bits, sizeof(value));
+    }
+    return half & 0x8000u ? -value : value;
+}
+
+#ifdef __SSE2__
+// the same conversions four at a time in plain SSE2, so they don't need F16C; each half
+// sits zero-extended in a 32-bit lane
+inline __m128 halvesToFloats(__m128i halves) {
+    // 2^112 moves the exponent from half bias to float bias and renormalizes subnormals
+    const __m128 rebias = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+    __m128i magnitude = _mm_and_si128(halves, _mm_set1_epi32(0x7FFF));
+    __m128 value = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), rebias);
+    __m128i sign = _mm_slli_epi32(_mm_xor_si128(halves, magnitude), 16);
+    return _mm_or_ps(value, _mm_castsi128_ps(sign));
+}
+
+// the sign is extended through the top of each lane, so _mm_packs_epi32 narrows the
+// halves without saturating them
+inline __m128i floatsToHalves(__m128 values) {
+    __m128 sign = _mm_and_ps(values, _mm_set1_ps(-0.f));
+    // min returns its second operand for nan
+    __m128 magnitude = _mm_min_ps(_mm_xor_ps(values, sign), _mm_set1_ps(65504.f));
+    __m128i bits = _mm_castps_si128(magnitude);
+    // subnormal half: adding 0.5 lines the mantissa up with the bottom bits and rounds it
+    const __m128 one_half = _mm_set1_ps(0.5f);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(magnitude, one_half)), _mm_castps_si128(one_half));
+    // rebias the exponent and round half to even
+    __m128i odd = _mm_srli_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0xC8000FFF)), odd), 13);
+    __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32(0x38800000), bits);
+    __m128i half = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    return _mm_or_si128(half, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+#endif
+
+// pixels to fixed-point units, saturating
+std::int16_t offsetOf(float pixels) {
+    long units = std::lrint(pixels * compact::units_per_pixel);
+    return static_cast<std::int16_t>(std::max(-32768l, std::min(units, 32767l)));
+}
+
+// offsets in fixed-point units to pixels, relative to the chunk's center
+void offsetsToFloats(const std::int16_t* offset, float* dst, unsigned int n) {
+    const float scale = 1.f / compact::units_per_pixel;
+    unsigned int i = 0;
+#ifdef __SSE2__
+    const __m128 scales = _mm_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i offsets = _mm_loadu_si128(reinterpret_cast<const __m128i*>(offset + i));
+        // sign-extend by unpacking each offset into the high half and shifting it back down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(offsets, offsets), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(offsets, offsets), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scales));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scales));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = offset[i] * scale;
+    }
+}
+
+// one step for bodies without contacts or springs: the explicit integrator, friction and
+// the walls, as moveEntity and wallBounce do them
+void stepFreeBodies(float* x, float* y, float* vx, float* vy, const float* radius, const MaterialId* materialId,
+        unsigned int n, float delta, float x_bound, float y_bound) {
+    for (unsigned int i = 0; i < n; ++i) {
+        float px = x[i] + vx[i] * delta;
+        float py = y[i] + vy[i] * delta;
+        float speed = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i]);
+        float slowed = std::max(0.f, speed - materials.friction[materialId[i]] * delta);
+        float scale = slowed > epsilon ? slowed / speed : 0.f;
+        float nvx = vx[i] * scale;
+        float nvy = vy[i] * scale;
+
+        // selects rather than branches so the loop vectorizes
+        float r = radius[i];
+        float bounce = -materials.elasticity[materialId[i]];
+        float cx = std::max(r, std::min(px, x_bound - r));
+        float cy = std::max(r, std::min(py, y_bound - r));
+        nvx = cx != px ? nvx * bounce : nvx;
+        nvy = cy != py ? nvy * bounce : nvy;
+        px = cx;
+        py = cy;
+        x[i] = px;
+        y[i] = py;
+        vx[i] = nvx;
+        vy[i] = nvy;
+    }
+}
+
+#ifdef __SSE2__
+template <typename Index>
+inline __m128 gatherLanes(const float* table, const Index* index) {
+    return _mm_setr_ps(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+}
+
+// stepFreeBodies for four bodies at once; the walls are given relative to wherever each
+// lane's position is measured from
+inline void stepFreeLanes(__m128& x, __m128& y, __m128& vx, __m128& vy, __m128 radius, const MaterialId* materialId,
+        float delta, __m128 left, __m128 top, __m128 right, __m128 bottom) {
+    const __m128 deltas = _mm_set1_ps(delta);
+    __m128 px = _mm_add_ps(x, _mm_mul_ps(vx, deltas));
+    __m128 py = _mm_add_ps(y, _mm_mul_ps(vy, deltas));
+    __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+    __m128 friction = gatherLanes(materials.friction, materialId);
+    __m128 slowed = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(speed, _mm_mul_ps(friction, deltas)));
+    // the 0 / 0 of a body at rest is masked off
+    __m128 moving = _mm_cmpgt_ps(slowed, _mm_set1_ps(epsilon));
+    __m128 scale = _mm_and_ps(moving, _mm_div_ps(slowed, speed));
+    __m128 nvx = _mm_mul_ps(vx, scale);
+    __m128 nvy = _mm_mul_ps(vy, scale);
+
+    __m128 bounce = _mm_sub_ps(_mm_setzero_ps(), gatherLanes(materials.elasticity, materialId));
+    __m128 cx = _mm_max_ps(_mm_add_ps(left, radius), _mm_min_ps(px, _mm_sub_ps(right, radius)));
+    __m128 cy = _mm_max_ps(_mm_add_ps(top, radius), _mm_min_ps(py, _mm_sub_ps(bottom, radius)));
+    __m128 hitX = _mm_cmpneq_ps(cx, px);
+    __m128 hitY = _mm_cmpneq_ps(cy, py);
+    x = cx;
+    y = cy;
+    vx = _mm_or_ps(_mm_and_ps(hitX, _mm_mul_ps(nvx, bounce)), _mm_andnot_ps(hitX, nvx));
+    vy = _mm_or_ps(_mm_and_ps(hitY, _mm_mul_ps(nvy, bounce)), _mm_andnot_ps(hitY, nvy));
+}
+#endif
+
+struct FloatBodyStore {
+    static constexpr unsigned int bytes_per_body{5 * sizeof(float) + sizeof(MaterialId)};
+
+    std::vector<float> x, y, vx, vy, radius;
+    std::vector<MaterialId> materialId;
+
+    void resize(unsigned int n) {
+        x.resize(n);
+        y.resize(n);
+        vx.resize(n);
+        vy.resize(n);
+        radius.resize(n);
+        materialId.resize(n);
+    }
+
+    void step(float delta, float x_bound, float y_bound) {
+        unsigned int n = x.size();
+        unsigned int i = 0;
+#ifdef __SSE2__
+        const __m128 left = _mm_setzero_ps();
+        const __m128 right = _mm_set1_ps(x_bound);
+        const __m128 bottom = _mm_set1_ps(y_bound);
+        for (; i + 4 <= n; i += 4) {
+            __m128 laneX = _mm_loadu_ps(&x[i]);
+            __m128 laneY = _mm_loadu_ps(&y[i]);
+            __m128 laneVX = _mm_loadu_ps(&vx[i]);
+            __m128 laneVY = _mm_loadu_ps(&vy[i]);
+            stepFreeLanes(laneX, laneY, laneVX, laneVY, _mm_loadu_ps(&radius[i]), &materialId[i],
+                delta, left, left, right, bottom);
+            _mm_storeu_ps(&x[i], laneX);
+            _mm_storeu_ps(&y[i], laneY);
+            _mm_storeu_ps(&vx[i], laneVX);
+            _mm_storeu_ps(&vy[i], laneVY);
+        }
+#endif
+        stepFreeBodies(x.data() + i, y.data() + i, vx.data() + i, vy.data() + i, radius.data() + i,
+            materialId.data() + i, n - i, delta, x_bound, y_bound);
+    }
+};
+
+// positions keep 1/64 px, so a body slower than half a unit per step (about 1 px/s at
+// 144 Hz) rounds back to where it was; friction puts those at rest soon anyway.
+// halves keep 11 bits, so each step's friction is rounded to the velocity's spacing
+// and a sliding body drifts a few px a second from where the float layout has it.
+// rebuilding the groups reorders the bodies; step and encode can report the old slot
+// of every body for callers that track them
+struct CompactBodyStore {
+    // on top of this, one index per chunk
+    static constexpr unsigned int bytes_per_body{4 * sizeof(std::uint16_t) + sizeof(std::uint8_t) + sizeof(MaterialId)};
+
+    // offsets from the center of the body's chunk
+    std::vector<std::int16_t> x, y;
+    std::vector<std::uint16_t> vx, vy;
+    std::vector<std::uint8_t> radiusClass;
+    std::vector<MaterialId> materialId;
+    // bodies [chunkStart[c], chunkStart[c + 1]) are in chunk c, counted row by row
+    std::vector<unsigned int> chunkStart;
+    unsigned int chunksX{1};
+    unsigned int chunksY{1};
+    std::array<float, compact::radius_classes> classRadius;
+    unsigned int regroups{0};
+
+    float bytesPerBody() const {
+        return bytes_per_body + static_cast<float>(chunkStart.size() * sizeof(unsigned int)) / std::max<std::size_t>(1, x.size());
+    }
+
+    sf::Vector2f chunkCenter(unsigned int chunk) const {
+        return {(chunk % chunksX + 0.5f) * compact::chunk_size, (chunk / chunksX + 0.5f) * compact::chunk_size};
+    }
+
+    // source, when given, gets the index in bodies of each stored body
+    void encode(const FloatBodyStore& bodies, float min_radius, float max_radius, float x_bound, float y_bound,
+            std::vector<unsigned int>* source = nullptr) {
+        unsigned int n = bodies.x.size();
+        chunksX = std::max(1u, static_cast<unsigned int>(std::ceil(x_bound / compact::chunk_size)));
+        chunksY = std::max(1u, static_cast<unsigned int>(std::ceil(y_bound / compact::chunk_size)));
+        std::vector<unsigned int> chunk(n);
+        for (unsigned int i = 0; i < n; ++i) {
+            unsigned int cx = std::min(chunksX - 1, static_cast<unsigned int>(std::max(0.f, bodies.x[i] / compact::chunk_size)));
+            unsigned int cy = std::min(chunksY - 1, static_cast<unsigned int>(std::max(0.f, bodies.y[i] / compact::chunk_size)));
+            chunk[i] = cy * chunksX + cx;
+        }
+        std::vector<unsigned int> order = groupByChunk(chunk);
+
+        float classWidth = (max_radius - min_radius) / (compact::radius_classes - 1);
+        for (unsigned int c = 0; c < compact::radius_classes; ++c) {
+            classRadius[c] = min_radius + c * classWidth;
+        }
+        x.resize(n);
+        y.resize(n);
+        vx.resize(n);
+        vy.resize(n);
+        radiusClass.resize(n);
+        materialId.resize(n);
+        for (unsigned int slot = 0; slot < n; ++slot) {
+            unsigned int i = order[slot];
+            sf::Vector2f center = chunkCenter(chunk[i]);
+            x[slot] = offsetOf(bodies.x[i] - center.x);
+            y[slot] = offsetOf(bodies.y[i] - center.y);
+            vx[slot] = floatToHalf(bodies.vx[i]);
+            vy[slot] = floatToHalf(bodies.vy[i]);
+            float c = classWidth > 0.f ? std::round((bodies.radius[i] - min_radius) / classWidth) : 0.f;
+            radiusClass[slot] = static_cast<std::uint8_t>(utility::clamp(c, 0.f, compact::radius_classes - 1.f));
+            materialId[slot] = bodies.materialId[i];
+        }
+        if (source) *source = std::move(order);
+    }
+
+    // in stored order
+    void decode(FloatBodyStore& bodies) const {
+        unsigned int n = x.size();
+        bodies.resize(n);
+        offsetsToFloats(x.data(), bodies.x.data(), n);
+        offsetsToFloats(y.data(), bodies.y.data(), n);
+        for (unsigned int c = 0; c + 1 < chunkStart.size(); ++c) {
+            sf::Vector2f center = chunkCenter(c);
+            for (unsigned int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+                bodies.x[i] += center.x;
+                bodies.y[i] += center.y;
+                bodies.vx[i] = halfToFloat(vx[i]);
+                bodies.vy[i] = halfToFloat(vy[i]);
+                bodies.radius[i] = classRadius[radiusClass[i]];
+            }
+        }
+        bodies.materialId = materialId;
+    }
+
+    // returns true if the groups were rebuilt; moved_from, when given, then gets the old
+    // slot of each body
+    bool step(float delta, float x_bound, float y_bound, std::vector<unsigned int>* moved_from = nullptr) {
+        std::int16_t low = 0;
+        std::int16_t high = 0;
+#ifdef __SSE2__
+        unsigned int n = x.size();
+        __m128i lows = _mm_setzero_si128();
+        __m128i highs = _mm_setzero_si128();
+        alignas(16) float centerX[4];
+        alignas(16) float centerY[4];
+        unsigned int chunk = 0;
+        sf::Vector2f center = chunkCenter(0);
+        for (unsigned int i = 0; i < n; i += 4) {
+            if (chunkStart[chunk + 1] <= i) {
+                while (chunkStart[chunk + 1] <= i) ++chunk;
+                center = chunkCenter(chunk);
+            }
+            __m128 laneCenterX = _mm_set1_ps(center.x);
+            __m128 laneCenterY = _mm_set1_ps(center.y);
+            if (chunkStart[chunk + 1] < std::min(i + 4, n)) {
+                // these four straddle chunks, so every lane gets its own center
+                for (unsigned int lane = 0; lane < 4; ++lane) {
+                    unsigned int slot = std::min(i + lane, n - 1);
+                    if (chunkStart[chunk + 1] <= slot) {
+                        while (chunkStart[chunk + 1] <= slot) ++chunk;
+                        center = chunkCenter(chunk);
+                    }
+                    centerX[lane] = center.x;
+                    centerY[lane] = center.y;
+                }
+                laneCenterX = _mm_load_ps(centerX);
+                laneCenterY = _mm_load_ps(centerY);
+            }
+            if (i + 4 <= n) {
+                stepLanes(&x[i], &y[i], &vx[i], &vy[i], &radiusClass[i], &materialId[i],
+                    delta, laneCenterX, laneCenterY, x_bound, y_bound, lows, highs);
+                continue;
+            }
+            // the last few go through the lanes too, padded with copies of the last body
+            std::int16_t tailX[4], tailY[4];
+            std::uint16_t tailVX[4], tailVY[4];
+            std::uint8_t tailClass[4];
+            MaterialId tailMaterial[4];
+            for (unsigned int lane = 0; lane < 4; ++lane) {
+                unsigned int slot = std::min(i + lane, n - 1);
+                tailX[lane] = x[slot];
+                tailY[lane] = y[slot];
+                tailVX[lane] = vx[slot];
+                tailVY[lane] = vy[slot];
+                tailClass[lane] = radiusClass[slot];
+                tailMaterial[lane] = materialId[slot];
+            }
+            stepLanes(tailX, tailY, tailVX, tailVY, tailClass, tailMaterial,
+                delta, laneCenterX, laneCenterY, x_bound, y_bound, lows, highs);
+            for (unsigned int lane = 0; i + lane < n; ++lane) {
+                x[i + lane] = tailX[lane];
+                y[i + lane] = tailY[lane];
+                vx[i + lane] = tailVX[lane];
+                vy[i + lane] = tailVY[lane];
+            }
+        }
+        alignas(16) std::int16_t lane[8];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lane), lows);
+        low = *std::min_element(lane, lane + 8);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lane), highs);
+        high = *std::max_element(lane, lane + 8);
+#else
+        for (unsigned int c = 0; c + 1 < chunkStart.size(); ++c) {
+            sf::Vector2f center = chunkCenter(c);
+            for (unsigned int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+                float bodyX = x[i] / compact::units_per_pixel + center.x;
+                float bodyY = y[i] / compact::units_per_pixel + center.y;
+                float bodyVX = halfToFloat(vx[i]);
+                float bodyVY = halfToFloat(vy[i]);
+                float radius = classRadius[radiusClass[i]];
+                stepFreeBodies(&bodyX, &bodyY, &bodyVX, &bodyVY, &radius, &materialId[i], 1, delta, x_bound, y_bound);
+                x[i] = offsetOf(bodyX - center.x);
+                y[i] = offsetOf(bodyY - center.y);
+                vx[i] = floatToHalf(bodyVX);
+                vy[i] = floatToHalf(bodyVY);
+                low = std::min({low, x[i], y[i]});
+                high = std::max({high, x[i], y[i]});
+            }
+        }
+#endif
+        if (low >= -compact::regroup_units && high <= compact::regroup_units) return false;
+        regroup(moved_from);
+        return true;
+    }
+
+private:
+#ifdef __SSE2__
+    // decodes four bodies, steps them and encodes them back; the lanes stay offsets from
+    // their chunk's center, so the walls move instead. lows and highs are widened to the
+    // smallest and largest offset written
+    void stepLanes(std::int16_t* laneX, std::int16_t* laneY, std::uint16_t* laneVX, std::uint16_t* laneVY,
+            const std::uint8_t* laneClass, const MaterialId* laneMaterial, float delta,
+            __m128 centerX, __m128 centerY, float x_bound, float y_bound, __m128i& lows, __m128i& highs) const {
+        const __m128 to_pixels = _mm_set1_ps(1.f / compact::units_per_pixel);
+        const __m128 to_units = _mm_set1_ps(compact::units_per_pixel);
+        __m128i offsetX = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(laneX));
+        __m128i offsetY = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(laneY));
+        // sign-extend by unpacking each offset into the high half and shifting it back down
+        __m128 bodyX = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(offsetX, offsetX), 16)), to_pixels);
+        __m128 bodyY = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(offsetY, offsetY), 16)), to_pixels);
+        __m128i halvesX = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(laneVX));
+        __m128i halvesY = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(laneVY));
+        __m128 bodyVX = halvesToFloats(_mm_unpacklo_epi16(halvesX, _mm_setzero_si128()));
+        __m128 bodyVY = halvesToFloats(_mm_unpacklo_epi16(halvesY, _mm_setzero_si128()));
+
+        stepFreeLanes(bodyX, bodyY, bodyVX, bodyVY, gatherLanes(classRadius.data(), laneClass), laneMaterial, delta,
+            _mm_sub_ps(_mm_setzero_ps(), centerX), _mm_sub_ps(_mm_setzero_ps(), centerY),
+            _mm_sub_ps(_mm_set1_ps(x_bound), centerX), _mm_sub_ps(_mm_set1_ps(y_bound), centerY));
+
+        __m128i unitsX = _mm_cvtps_epi32(_mm_mul_ps(bodyX, to_units));
+        __m128i unitsY = _mm_cvtps_epi32(_mm_mul_ps(bodyY, to_units));
+        offsetX = _mm_packs_epi32(unitsX, unitsX);
+        offsetY = _mm_packs_epi32(unitsY, unitsY);
+        lows = _mm_min_epi16(lows, _mm_min_epi16(offsetX, offsetY));
+        highs = _mm_max_epi16(highs, _mm_max_epi16(offsetX, offsetY));
+        halvesX = floatsToHalves(bodyVX);
+        halvesY = floatsToHalves(bodyVY);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(laneX), offsetX);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(laneY), offsetY);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(laneVX), _mm_packs_epi32(halvesX, halvesX));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(laneVY), _mm_packs_epi32(halvesY, halvesY));
+    }
+#endif
+
+    // a counting sort by chunk; fills chunkStart and returns the body in each slot
+    std::vector<unsigned int> groupByChunk(const std::vector<unsigned int>& chunk) {
+        chunkStart.assign(chunksX * chunksY + 1, 0);
+        for (unsigned int c : chunk) {
+            ++chunkStart[c + 1];
+        }
+        std::partial_sum(chunkStart.begin(), chunkStart.end(), chunkStart.begin());
+        std::vector<unsigned int> next(chunkStart.begin(), chunkStart.end() - 1);
+        std::vector<unsigned int> order(chunk.size());
+        for (unsigned int i = 0; i < chunk.size(); ++i) {
+            order[next[chunk[i]]++] = i;
+        }
+        return order;
+    }
+
+    // moves every body into the chunk it is in now, in whole chunks of offset
+    void regroup(std::vector<unsigned int>* moved_from) {
+        unsigned int n = x.size();
+        std::vector<unsigned int> chunk(n);
+        for (unsigned int c = 0; c + 1 < chunkStart.size(); ++c) {
+            int cx = c % chunksX;
+            int cy = c / chunksX;
+            for (unsigned int i = chunkStart[c]; i < chunkStart[c + 1]; ++i) {
+                int nx = utility::clamp(cx + shiftOf(x[i]), 0, static_cast<int>(chunksX) - 1);
+                int ny = utility::clamp(cy + shiftOf(y[i]), 0, static_cast<int>(chunksY) - 1);
+                x[i] = static_cast<std::int16_t>(x[i] - (nx - cx) * compact::chunk_units);
+                y[i] = static_cast<std::int16_t>(y[i] - (ny - cy) * compact::chunk_units);
+                chunk[i] = ny * chunksX + nx;
+            }
+        }
+        std::vector<unsigned int> order = groupByChunk(chunk);
+        reorder(x, order);
+        reorder(y, order);
+        reorder(vx, order);
+        reorder(vy, order);
+        reorder(radiusClass, order);
+        reorder(materialId, order);
+        ++regroups;
+        if (moved_from) *moved_from = std::move(order);
+    }
+
+    // how many chunks over an offset points, rounded to the nearest
+    static int shiftOf(std::int16_t offset) {
+        return static_cast<int>(std::floor((offset + compact::chunk_units / 2.f) / compact::chunk_units));
+    }
+
+    template <typename T>
+    static void reorder(std::vector<T>& values, const std::vector<unsigned int>& order) {
+        std::vector<T> moved(values.size());
+        for (unsigned int slot = 0; slot < order.size(); ++slot) {
+            moved[slot] = values[order[slot]];
+        }
+        values.swap(moved);
+    }
+};
+
+// kinetic plus spring energy of the enemies; static bodies don't count
+double totalEnergy() {
+    double energy = 0.0;
+    for (const BallEntity& body : otherBallEntities) {
+        float inverseMass = materials.inverseMass[body.materialId];
+        if (inverseMass <= 0.f) continue;
+        sf::Vector2f stretch = body.ball.getPosition() - body.anchor;
+        energy += 0.5 / inverseMass * (dot(body.velocity, body.velocity) + spring_stiffness * dot(stretch, stretch));
+    }
+    return energy;
+}
+
+// runs the scene headless at a single rate with contacts and friction off and the walls
+// pushed out of reach, so any change in energy is the integrator's
+template <typename Integrator>
+void benchmarkIntegrator(const char* name, float rate, unsigned int steps, float stiffness) {
+    initializeSettings();
+    spring_stiffness = stiffness;
+    gfrictionEnabled = false;
+    multiRateEnabled = false;
+    arena_w *= 1000;
+    arena_h *= 1000;
+    for (unsigned int i = 0; i < num_circles; ++i) {
+        otherBallEntities[i].mask = 0;
+        otherBallEntities[i].velocity = sf::Vector2f(std::cos(i * 2.4f), std::sin(i * 2.4f)) * 200.f;
+    }
+    userBallEntity.mask = 0;
+
+    sf::Time stepTime = sf::seconds(1.f / rate);
+    double startEnergy = totalEnergy();
+    double maxDrift = 0.0;
+    sf::Clock clock;
+    for (unsigned int step = 0; step < steps; ++step) {
+        update<Integrator>(stepTime);
+        if (step % 16 == 15 && startEnergy > 0.0) {
+            maxDrift = std::max(maxDrift, std::fabs(totalEnergy() - startEnergy) / startEnergy);
+        }
+    }
+    float seconds = clock.getElapsedTime().asSeconds();
+    std::cout << name << " @ " << rate << " Hz: " << steps / seconds << " steps/s, max energy drift "
+              << maxDrift * 100.0 << "%\n";
+}
+
+void runBenchmark(unsigned int steps) {
+    initializeSettings();
+    // without springs every integrator is exact; every run re-reads the settings, so each gets it again
+    float stiffness = spring_stiffness > 0.f ? spring_stiffness : 400.f;
+    std::cout << "benchmark: " << num_circles << " bodies, " << steps << " steps, spring stiffness " << stiffness << "\n";
+    for (float rate : {144.f, 60.f, 30.f}) {
+        benchmarkIntegrator<ExplicitStep>("explicit", rate, steps, stiffness);
+        benchmarkIntegrator<SemiImplicitEuler>("semi-implicit Euler", rate, steps, stiffness);
+        benchmarkIntegrator<VelocityVerlet>("velocity Verlet", rate, steps, stiffness);
+        benchmarkIntegrator<ForestRuth>("Forest-Ruth", rate, steps, stiffness);
+    }
+}
+
+// steps a Poisson scene of free bodies in both layouts and compares speed and drift
+void runStorageBenchmark(unsigned int bodies, unsigned int steps) {
+    initializeSettings();
+    sf::Vector2f userStart;
+    std::vector<SceneBall> scene = placeEnemies(bodies, userStart);
+    if (arena_w / compact::chunk_size >= compact::max_chunks || arena_h / compact::chunk_size >= compact::max_chunks) {
+        std::cout << "arena too large for the compact layout\n";
+        return;
+    }
+    MaterialId enemy_material_id = otherBallEntities.empty() ? 0 : otherBallEntities[0].materialId;
+
+    FloatBodyStore floatBodies;
+    floatBodies.resize(scene.size());
+    for (unsigned int i = 0; i < scene.size(); ++i) {
+        sf::Vector2f velocity = sf::Vector2f(std::cos(i * 2.4f), std::sin(i * 2.4f)) * (100.f + (i % 7) * 50.f);
+        floatBodies.x[i] = scene[i].position.x;
+        floatBodies.y[i] = scene[i].position.y;
+        floatBodies.vx[i] = velocity.x;
+        floatBodies.vy[i] = velocity.y;
+        floatBodies.radius[i] = scene[i].radius;
+        floatBodies.materialId[i] = enemy_material_id;
+    }
+    // bodyAt[slot] is the float body in each compact slot, which changes as they regroup
+    CompactBodyStore compactBodies;
+    std::vector<unsigned int> bodyAt;
+    compactBodies.encode(floatBodies, enemy_radius, enemy_radius_max, arena_w, arena_h, &bodyAt);
+    std::cout << "storage benchmark: " << scene.size() << " bodies, " << steps << " steps\n";
+
+    float delta = fixed_update_time.asSeconds();
+    sf::Clock clock;
+    for (unsigned int step = 0; step < steps; ++step) {
+        floatBodies.step(delta, arena_w, arena_h);
+    }
+    float floatSeconds = clock.restart().asSeconds();
+    std::vector<unsigned int> movedFrom;
+    std::vector<unsigned int> regrouped(bodyAt.size());
+    for (unsigned int step = 0; step < steps; ++step) {
+        if (compactBodies.step(delta, arena_w, arena_h, &movedFrom)) {
+            for (unsigned int slot = 0; slot < movedFrom.size(); ++slot) {
+                regrouped[slot] = bodyAt[movedFrom[slot]];
+            }
+            bodyAt.swap(regrouped);
+        }
+    }
+    float compactSeconds = clock.getElapsedTime().asSeconds();
+
+    FloatBodyStore decoded;
+    compactBodies.decode(decoded);
+    float maxError = 0.f;
+    for (unsigned int i = 0; i < scene.size(); ++i) {
+        unsigned int body = bodyAt[i];
+        maxError = std::max(maxError, std::hypot(decoded.x[i] - floatBodies.x[body], decoded.y[i] - floatBodies.y[body]));
+    }
+    std::cout << "float: " << FloatBodyStore::bytes_per_body << " bytes/body, " << steps / floatSeconds << " steps/s\n";
+    std::cout << "compact: " << compactBodies.bytesPerBody() << " bytes/body, " << steps / compactSeconds
+              << " steps/s, " << compactBodies.regroups << " regroups, max position error " << maxError << " px\n";
+}
+
+// hw06 --bench [steps] runs the integrator benchmark without opening a window
+// hw06 --bench-storage [bodies] [steps] compares the float and compact body layouts
+int main (int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        runBenchmark(argc > 2 ? std::stoul(argv[2]) : 2000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-storage") {
+        runStorageBenchmark(argc > 2 ? std::stoul(argv[2]) : 1000000, argc > 3 ? std::stoul(argv[3]) : 100);
+        return 0;
+    }
+
     srand(time(NULL));
     sf::RenderWindow window(sf::VideoMode(window_w, window_h), "HW 6");
 	window.setFramerateLimit(fps_limit);
 
     initializeSettings();
+    if (!ballRenderer.initialize()) {
+        std::cout << "Initialization unsuccessful.\n";
+        return 0;
+    }
+#ifdef PHYSICS_STATS
+    physicsStats.fontLoaded = physicsStats.font.loadFromFile("arial.ttf");
+#endif
     
     sf::Clock clock;
     sf::Time timeSinceLastUpdate;
@@ -0,0 +1,176 @@
+#ifndef PARTICLE_SYSTEM_HPP
+#define PARTICLE_SYSTEM_HPP
+
+// short-lived particles for hit and despawn effects, up to a fixed capacity.
+// particles are kept as separate arrays (x, y, velocity, life, color) so the update
+// streams through them four at a time; bursts wait in a ring until the next update,
+// dead particles are squeezed out in one pass afterwards, and every live particle
+// goes into one vertex array that is drawn in a single call
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <SFML/Graphics.hpp>
+#include "game_rng.hpp"
+
+struct ParticleBurst {
+    sf::Vector2f position;
+    sf::Color color;
+    unsigned int count;
+    // radians, 0 is +x and y points down; particles go up to spread either side of it
+    float direction;
+    float spread;
+};
+
+class ParticleSystem {
+public:
+    float lifetime{0.6f};
+    float minSpeed{60.f};
+    float maxSpeed{260.f};
+    float gravity{600.f};
+    float particleSize{3.f};
+
+    // capacity is rounded up to a multiple of 4 for the update
+    void initialize(unsigned int capacity, unsigned int burst_capacity) {
+        unsigned int padded = (capacity + 3) / 4 * 4;
+        _capacity = capacity;
+        _x.assign(padded, 0.f);
+        _y.assign(padded, 0.f);
+        _vx.assign(padded, 0.f);
+        _vy.assign(padded, 0.f);
+        _life.assign(padded, 0.f);
+        _color.assign(padded, sf::Color::White);
+        _count = 0;
+        _ring.assign(std::max(1u, burst_capacity), ParticleBurst());
+        _head = 0;
+        _queued = 0;
+        _dropped = 0;
+        _vertices.setPrimitiveType(sf::Quads);
+        // visual only, so it never touches the game's streams
+        _rng = rng::Pcg32(0, 0);
+    }
+
+    // queued until the next update; a full ring drops its oldest burst
+    void emit(const ParticleBurst& burst) {
+        unsigned int slot = (_head + _queued) % _ring.size();
+        if (_queued == _ring.size()) {
+            _head = (_head + 1) % _ring.size();
+            _dropped += _ring[slot].count;
+        } else {
+            ++_queued;
+        }
+        _ring[slot] = burst;
+    }
+
+    void update(float delta) {
+        spawnQueued();
+        integrate(delta);
+        compact();
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (_count == 0) return;
+        _vertices.resize(_count * 4);
+        float half = particleSize / 2.f;
+        float fade = 255.f / lifetime;
+        for (unsigned int i = 0; i < _count; ++i) {
+            sf::Color color = _color[i];
+            color.a = static_cast<sf::Uint8>(std::min(255.f, _life[i] * fade) * color.a / 255.f);
+            sf::Vertex* quad = &_vertices[i * 4];
+            quad[0] = sf::Vertex(sf::Vector2f(_x[i] - half, _y[i] - half), color);
+            quad[1] = sf::Vertex(sf::Vector2f(_x[i] + half, _y[i] - half), color);
+            quad[2] = sf::Vertex(sf::Vector2f(_x[i] + half, _y[i] + half), color);
+            quad[3] = sf::Vertex(sf::Vector2f(_x[i] - half, _y[i] + half), color);
+        }
+        target.draw(_vertices);
+    }
+
+    unsigned int liveCount() const {
+        return _count;
+    }
+
+    // particles that didn't fit, in the ring or in the arrays
+    unsigned long dropped() const {
+        return _dropped;
+    }
+
+private:
+    void spawnQueued() {
+        for (; _queued > 0; --_queued, _head = (_head + 1) % _ring.size()) {
+            const ParticleBurst& burst = _ring[_head];
+            unsigned int count = std::min(burst.count, _capacity - _count);
+            _dropped += burst.count - count;
+            for (unsigned int n = 0; n < count; ++n, ++_count) {
+                float angle = burst.direction + burst.spread * (2.f * _rng.unit() - 1.f);
+                float speed = _rng.uniform(minSpeed, maxSpeed);
+                _x[_count] = burst.position.x;
+                _y[_count] = burst.position.y;
+                _vx[_count] = std::cos(angle) * speed;
+                _vy[_count] = std::sin(angle) * speed;
+                // a little variety, so a burst thins out instead of vanishing at once
+                _life[_count] = lifetime * _rng.uniform(0.6f, 1.f);
+                _color[_count] = burst.color;
+            }
+        }
+    }
+
+    // position, velocity and life, four particles per iteration. the padding past
+    // _count is updated too and thrown away by compact()
+    void integrate(float delta) {
+        unsigned int padded = (_count + 3) / 4 * 4;
+        float fall = gravity * delta;
+        unsigned int i = 0;
+#ifdef __SSE2__
+        __m128 dt = _mm_set1_ps(delta);
+        __m128 dv = _mm_set1_ps(fall);
+        for (; i < padded; i += 4) {
+            __m128 vx = _mm_loadu_ps(&_vx[i]);
+            __m128 vy = _mm_add_ps(_mm_loadu_ps(&_vy[i]), dv);
+            _mm_storeu_ps(&_x[i], _mm_add_ps(_mm_loadu_ps(&_x[i]), _mm_mul_ps(vx, dt)));
+            _mm_storeu_ps(&_y[i], _mm_add_ps(_mm_loadu_ps(&_y[i]), _mm_mul_ps(vy, dt)));
+            _mm_storeu_ps(&_vy[i], vy);
+            _mm_storeu_ps(&_life[i], _mm_sub_ps(_mm_loadu_ps(&_life[i]), dt));
+        }
+#endif
+        for (; i < padded; ++i) {
+            _vy[i] += fall;
+            _x[i] += _vx[i] * delta;
+            _y[i] += _vy[i] * delta;
+            _life[i] -= delta;
+        }
+    }
+
+    // one pass that slides every live particle down over the dead ones, in order
+    void compact() {
+        unsigned int live = 0;
+        for (unsigned int i = 0; i < _count; ++i) {
+            if (_life[i] <= 0.f) continue;
+            if (live != i) {
+                _x[live] = _x[i];
+                _y[live] = _y[i];
+                _vx[live] = _vx[i];
+                _vy[live] = _vy[i];
+                _life[live] = _life[i];
+                _color[live] = _color[i];
+            }
+            ++live;
+        }
+        _count = live;
+    }
+
+    unsigned int _capacity{0};
+    unsigned int _count{0};
+    std::vector<float> _x, _y, _vx, _vy, _life;
+    std::vector<sf::Color> _color;
+    std::vector<ParticleBurst> _ring;
+    unsigned int _head{0};
+    unsigned int _queued{0};
+    unsigned long _dropped{0};
+    rng::Pcg32 _rng;
+    sf::VertexArray _vertices;
+};
+
+#endif
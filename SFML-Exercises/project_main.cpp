@@ -1,9 +1,23 @@
 #include <iostream>
 #include <math.h>
 #include <fstream>
-#include <random>
 #include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <numeric>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <queue>
+#include <stdexcept>
 #include <SFML/Graphics.hpp>
+#include "game_rng.hpp"
+#include "swept_collision.hpp"
+#include "falling_ball_envs.hpp"
+#include "ball_batch_renderer.hpp"
+#include "particle_system.hpp"
 
 namespace utility {
     // in case the person compiling this does not have C++17 installed
@@ -40,14 +54,52 @@ namespace default_vals {
         constexpr float radius{30.f};
         const sf::Time ballGenerationPeriod = sf::seconds(0.25f);
         const sf::Color color = sf::Color::Red;
+        constexpr float min_speed{100.f};
+        constexpr float max_speed{1000.f};
+        constexpr unsigned int pool_capacity{200};
+        // no growth unless the settings ask for it
+        constexpr unsigned int pool_max_capacity{200};
     }
+    // the other falling kinds; a zero period leaves that kind out
+    namespace particles {
+        constexpr unsigned int capacity{100000};
+        constexpr unsigned int burst_capacity{1024};
+        constexpr unsigned int hit_count{48};
+        constexpr unsigned int exit_count{12};
+    }
+    namespace kinds {
+        const sf::Time power_up_period = sf::Time::Zero;
+        const sf::Time bomb_period = sf::Time::Zero;
+        const sf::Time homing_period = sf::Time::Zero;
+        const sf::Color power_up_color = sf::Color::Green;
+        const sf::Color bomb_color = sf::Color::Magenta;
+        const sf::Color homing_color = sf::Color::Yellow;
+        // radius as a fraction of a ball's
+        constexpr float power_up_scale{0.6f};
+        constexpr float bomb_scale{1.f};
+        constexpr float homing_scale{0.8f};
+        constexpr unsigned int pool_capacity{32};
+    }
+}
+
+// one random stream per subsystem
+namespace rng_streams {
+    constexpr std::uint64_t spawns{1};
+    constexpr std::uint64_t power_ups{2};
+    constexpr std::uint64_t bombs{3};
+    constexpr std::uint64_t homing{4};
+    // random actions for --envs, one stream per thread from here up
+    constexpr std::uint64_t actions{16};
 }
 
-std::random_device rd;
 std::string fontFileName{default_vals::fontFileName};
 unsigned int fontSize{default_vals::fontSize};
 
-unsigned int score{0};
+// swept::circleRectTime for SFML types
+float sweptCircleRectTime(const sf::Vector2f& start, const sf::Vector2f& move, float r, const sf::FloatRect& rect) {
+    return swept::circleRectTime(start.x, start.y, move.x, move.y, r,
+        rect.left, rect.top, rect.left + rect.width, rect.top + rect.height);
+}
 
 struct BallEntity {
     sf::CircleShape ball;
@@ -122,104 +174,768 @@ struct BallEntity {
             return false;
         }
     }
+
+    // whether the ball touched rect at any time during the step it just took, moving
+    // by velocity * delta while rect moved by rectShift; collidesWith only looks at the
+    // end, which a fast ball or a thin paddle can skip past
+    bool sweptCollidesWith(const sf::RectangleShape& rect, const sf::Vector2f& rectShift, float delta) const {
+        sf::Vector2f moved = velocity * delta;
+        sf::Vector2f rectStart = rect.getPosition() - rectShift;
+        sf::FloatRect bounds(rectStart.x, rectStart.y, rect.getSize().x, rect.getSize().y);
+        // in the rect's frame
+        return sweptCircleRectTime(ball.getPosition() - moved, moved - rectShift, radius, bounds) <= 1.f;
+    }
+};
+
+// an entity that left the screen or hit the paddle, for the particle effects
+struct DespawnEvent {
+    sf::Vector2f position;
+    sf::Color color;
+    bool hit;
+};
+
+// what one tick did to the game
+struct TickResult {
+    unsigned int score{0};
+    int hits{0};
+    unsigned int despawns{0};
 };
 
-class BallPool {
+// one ball the spawn scheduler wants, due at time; its x is drawn from [x_min, x_max]
+struct SpawnRequest {
+    sf::Time time;
+    float xMin;
+    float xMax;
+};
+
+// how close the pool came to running out
+struct PoolStats {
+    unsigned int peakLive{0};
+    unsigned int spawnFailures{0};
+    unsigned int growthEvents{0};
+};
+
+// the rules of one kind of falling object, used statically by its EntityPool:
+// move() advances one entity toward the end of the step (target is the paddle's center),
+// exit_score is what it's worth when it leaves the screen, hit_damage is the HP it takes
+// when it touches the paddle (negative gives HP back), and moves_sideways says whether
+// it can change lanes, at up to max_side_speed
+struct FallingBehavior {
+    static constexpr unsigned int exit_score{10};
+    static constexpr int hit_damage{1};
+    static constexpr bool moves_sideways{false};
+    static constexpr float max_side_speed{0.f};
+
+    static void move(BallEntity& entity, float delta, const sf::Vector2f&) {
+        entity.moveEntity(zero_vector, delta);
+    }
+};
+
+// caught, it gives an HP back; missed, it's worth nothing
+struct PowerUpBehavior : FallingBehavior {
+    static constexpr unsigned int exit_score{0};
+    static constexpr int hit_damage{-1};
+};
+
+struct BombBehavior : FallingBehavior {
+    static constexpr int hit_damage{3};
+};
+
+// drifts toward the paddle's center as it falls, never past it
+struct HomingBehavior : FallingBehavior {
+    static constexpr unsigned int exit_score{20};
+    static constexpr bool moves_sideways{true};
+    // sideways speed per pixel of distance, and its cap
+    static constexpr float steering{1.5f};
+    static constexpr float max_side_speed{150.f};
+
+    static void move(BallEntity& entity, float delta, const sf::Vector2f& target) {
+        float side = steering * (target.x - entity.ball.getPosition().x);
+        entity.velocity.x = utility::clamp(side, -max_side_speed, max_side_speed);
+        entity.moveEntity(zero_vector, delta);
+    }
+};
+
+// one pool per kind of falling object, T its entity and Behavior its rules, so every
+// kind is stored contiguously and stepped by its own loop with no virtual calls.
+// live entities are tracked explicitly: _live is a dense list of the slots in use
+// and _free is a stack of the unused ones, so spawning and despawning are O(1)
+// and every pass touches only live entities.
+// entities live in chunks that are never moved, so an entity's address stays valid when
+// the pool grows; a full pool doubles, up to max_capacity.
+// live entities are also bucketed into lanes one entity wide. most kinds fall straight
+// down and keep their lane; each lane is kept lowest first so the paddle only has to
+// look at the bottom of the lanes above it
+template <typename T, typename Behavior>
+class EntityPool {
 public:
     float x_bound;
     float y_bound;
-    BallPool() = default;
-    bool initializeBallPool(float xb, float yb, float radius, sf::Color c, sf::Vector2f std_v) {
+    // where despawns are reported for effects; null when nothing is drawn
+    std::vector<DespawnEvent>* despawnEvents{nullptr};
+    rng::Pcg32 spawnRng;
+    float minSpeed{default_vals::balls::min_speed};
+    float maxSpeed{default_vals::balls::max_speed};
+    EntityPool() = default;
+    bool initializeBallPool(float xb, float yb, float radius, sf::Color c, sf::Vector2f std_v,
+            unsigned int capacity, unsigned int max_capacity) {
         if (2*radius > xb || 2*radius > yb) {
             std::cout << "radius is too large for the screen\n";
             return false;
         }
+        if (capacity == 0) {
+            std::cout << "the ball pool needs at least one ball\n";
+            return false;
+        }
         x_bound = xb;
         y_bound = yb;
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            _ballPool[i].setColor(c);
-            _ballPool[i].radius = radius;
-            _ballPool[i].initializeEntity(-radius, -radius);
-            _ballPool[i].setVelocity(std_v);
-        }
+        _prototype.setColor(c);
+        _prototype.radius = radius;
+        _prototype.initializeEntity(-radius, -radius);
+        _prototype.setVelocity(std_v);
+        _maxCapacity = std::max(capacity, max_capacity);
+        _laneWidth = 2 * radius;
+        _lanes.assign(static_cast<unsigned int>(std::ceil(xb / _laneWidth)), std::vector<unsigned int>());
+        _chunks.clear();
+        _slots.clear();
+        _laneOf.clear();
+        _liveIndex.clear();
+        _stats = PoolStats();
+        addChunk(capacity);
+        resetAllBalls();
         return true;
     }
     void updateAllBallsInBound(float delta, unsigned int& s) {
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            if (_ballPool[i].isInBounds(x_bound, y_bound)) {
-                _ballPool[i].moveEntity(zero_vector, delta);
-                if (!_ballPool[i].isInBounds(x_bound, y_bound)) {
-                    s += 10;
-                }
-            } 
+        for (unsigned int k = 0; k < _live.size();) {
+            T& entity = *_slots[_live[k]];
+            entity.moveEntity(zero_vector, delta);
+            if (!entity.isInBounds(x_bound, y_bound)) {
+                s += Behavior::exit_score;
+                report(_live[k], false);
+                despawn(k);
+            } else {
+                ++k;
+            }
         }
+        sortLanes();
     }
     // puts all balls out of bounds
     void resetAllBalls() {
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            _ballPool[i].ball.setPosition(-_ballPool[i].radius,-_ballPool[i].radius);
+        _live.clear();
+        _free.clear();
+        for (std::vector<unsigned int>& lane : _lanes) {
+            lane.clear();
+        }
+        for (unsigned int i = _slots.size(); i-- > 0;) {
+            _slots[i]->ball.setPosition(-_slots[i]->radius, -_slots[i]->radius);
+            _free.push_back(i);
         }
     }
     void generateFallingBall() {
-        std::mt19937 gen(rand()); // change to rd() if using MinGW10
-        std::uniform_int_distribution<int> distrib_w(0, x_bound);
-        std::uniform_real_distribution<float> distrib_vel(100.f, 1000.f);
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            if (!_ballPool[i].isInBounds(x_bound, y_bound)) {
-                int gen_x = distrib_w(gen);
-                sf::Vector2f gen_vel{0.f, distrib_vel(gen)};
-                float ballRadius = _ballPool[i].radius;
-                if (gen_x - ballRadius < 0)
-                    gen_x = ballRadius;
-                if (gen_x + ballRadius > x_bound)
-                    gen_x = x_bound - ballRadius;
-                _ballPool[i].setVelocity(gen_vel);
-                _ballPool[i].ball.setPosition(gen_x, ballRadius);
-                break;
+        spawnBall(0.f, x_bound, 0.f);
+    }
+
+    // spawns a whole batch; each ball has already been falling since its request's time,
+    // so spawns that came due mid-step start where they would be by now
+    void spawnBatch(const std::vector<SpawnRequest>& batch, sf::Time now) {
+        for (const SpawnRequest& request : batch) {
+            spawnBall(request.xMin, request.xMax, (now - request.time).asSeconds());
+        }
+    }
+
+    bool spawnBall(float x_min, float x_max, float age) {
+        if (_free.empty() && !grow()) {
+            _stats.spawnFailures++;
+            return false;
+        }
+        unsigned int i = _free.back();
+        _free.pop_back();
+        int gen_x = spawnRng.range(x_min, x_max);
+        sf::Vector2f gen_vel{0.f, spawnRng.uniform(minSpeed, maxSpeed)};
+        float ballRadius = _slots[i]->radius;
+        if (gen_x - ballRadius < 0)
+            gen_x = ballRadius;
+        if (gen_x + ballRadius > x_bound)
+            gen_x = x_bound - ballRadius;
+        _slots[i]->setVelocity(gen_vel);
+        _slots[i]->ball.setPosition(gen_x, ballRadius);
+        _slots[i]->moveEntity(zero_vector, age);
+        _liveIndex[i] = _live.size();
+        _live.push_back(i);
+        // new balls are the highest in their lane, give or take a faster one
+        _laneOf[i] = laneAt(gen_x);
+        _lanes[_laneOf[i]].push_back(i);
+        _stats.peakLive = std::max<unsigned int>(_stats.peakLive, _live.size());
+        return true;
+    }
+
+    // the whole tick in one pass over the live balls: move, leave the screen for points
+    // or hit the paddle for damage. does what updateAllBallsInBound, ballsCollidingWith
+    // and resetBallsOnCollision do together, which stay as the reference. the paddle
+    // test here is swept (paddleShift is how far the paddle moved this step), so a ball
+    // that crossed the paddle during the step hits it even if it ends up past it or
+    // off the screen; the reference only tests where everything ends up
+    TickResult tick(float delta, const sf::RectangleShape& paddle, const sf::Vector2f& paddleShift) {
+        TickResult result;
+        sf::Vector2f target = paddle.getPosition() + paddle.getSize() / 2.f;
+        int exitHits = 0;
+        for (unsigned int k = 0; k < _live.size();) {
+            T& entity = *_slots[_live[k]];
+            Behavior::move(entity, delta, target);
+            if (!entity.isInBounds(x_bound, y_bound)) {
+                bool hit = entity.sweptCollidesWith(paddle, paddleShift, delta);
+                if (hit) {
+                    exitHits++;
+                } else {
+                    result.score += Behavior::exit_score;
+                }
+                report(_live[k], hit);
+                despawn(k);
+                result.despawns++;
+            } else {
+                if (Behavior::moves_sideways) changeLane(_live[k]);
+                ++k;
+            }
+        }
+        sortLanes();
+
+        // anything that could have reached the paddle this step: up to maxSpeed * delta
+        // below it, and as far to the side as the paddle and the entity moved
+        float below = maxSpeed * delta;
+        float side = std::abs(paddleShift.x) + Behavior::max_side_speed * delta;
+        _hits.clear();
+        forEachPaddleCandidate(paddle, below, side, [&](unsigned int i) {
+            if (_slots[i]->sweptCollidesWith(paddle, paddleShift, delta)) {
+                _hits.push_back(i);
             }
+        });
+        for (unsigned int i : _hits) {
+            report(i, true);
+            despawn(_liveIndex[i]);
         }
+        result.hits += Behavior::hit_damage * (exitHits + static_cast<int>(_hits.size()));
+        result.despawns += _hits.size();
+        return result;
     }
 
     int ballsCollidingWith(const sf::RectangleShape& paddle) {
         int ans = 0;
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            if (_ballPool[i].isInBounds(x_bound, y_bound) && _ballPool[i].collidesWith(paddle)) {
+        forEachPaddleCandidate(paddle, 0.f, 0.f, [&](unsigned int i) {
+            if (_slots[i]->collidesWith(paddle)) {
                 ans++;
             }
-        }
+        });
         return ans;
     }
 
     void resetBallsOnCollision(const sf::RectangleShape& paddle) {
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            if (_ballPool[i].isInBounds(x_bound, y_bound) && _ballPool[i].collidesWith(paddle)) {
-                _ballPool[i].ball.setPosition(-_ballPool[i].radius, -_ballPool[i].radius);
+        _hits.clear();
+        forEachPaddleCandidate(paddle, 0.f, 0.f, [&](unsigned int i) {
+            if (_slots[i]->collidesWith(paddle)) {
+                _hits.push_back(i);
             }
+        });
+        for (unsigned int i : _hits) {
+            report(i, true);
+            despawn(_liveIndex[i]);
+        }
+    }
+
+    void drawVisibleBalls(BallBatchRenderer& batch) {
+        for (unsigned int k = 0; k < _live.size(); ++k) {
+            batch.add(_slots[_live[k]]->ball.getPosition(), _slots[_live[k]]->radius, _slots[_live[k]]->color);
+        }
+    }
+
+    template <typename F>
+    void forEachLive(F f) const {
+        for (unsigned int k = 0; k < _live.size(); ++k) {
+            f(*_slots[_live[k]]);
         }
     }
 
-    void drawVisibleBalls(sf::RenderWindow& window) {
-        for (unsigned int i = 0; i < _pool_size; ++i) {
-            if (_ballPool[i].isInBounds(x_bound, y_bound)) {
-                window.draw(_ballPool[i].ball);
+    unsigned int capacity() const {
+        return _slots.size();
+    }
+
+    const PoolStats& stats() const {
+        return _stats;
+    }
+
+private:
+    void report(unsigned int i, bool hit) {
+        if (despawnEvents) despawnEvents->push_back({_slots[i]->ball.getPosition(), _slots[i]->color, hit});
+    }
+
+    // the last live slot takes the despawned one's place in _live
+    void despawn(unsigned int k) {
+        unsigned int i = _live[k];
+        _slots[i]->ball.setPosition(-_slots[i]->radius, -_slots[i]->radius);
+        _live[k] = _live.back();
+        _liveIndex[_live[k]] = k;
+        _live.pop_back();
+        _free.push_back(i);
+        std::vector<unsigned int>& lane = _lanes[_laneOf[i]];
+        lane.erase(std::find(lane.begin(), lane.end(), i));
+    }
+
+    void changeLane(unsigned int i) {
+        unsigned int lane = laneAt(_slots[i]->ball.getPosition().x);
+        if (lane == _laneOf[i]) return;
+        std::vector<unsigned int>& old = _lanes[_laneOf[i]];
+        old.erase(std::find(old.begin(), old.end(), i));
+        _lanes[lane].push_back(i);
+        _laneOf[i] = lane;
+    }
+
+    unsigned int laneAt(float x) const {
+        int lane = static_cast<int>(x / _laneWidth);
+        return std::max(0, std::min(lane, static_cast<int>(_lanes.size()) - 1));
+    }
+
+    // entities of different speeds can pass each other, so the lanes are re-sorted after
+    // every move; they are nearly sorted already, which insertion sort handles in one pass
+    void sortLanes() {
+        for (std::vector<unsigned int>& lane : _lanes) {
+            for (unsigned int j = 1; j < lane.size(); ++j) {
+                unsigned int i = lane[j];
+                float y = _slots[i]->ball.getPosition().y;
+                unsigned int k = j;
+                for (; k > 0 && _slots[lane[k - 1]]->ball.getPosition().y < y; --k) {
+                    lane[k] = lane[k - 1];
+                }
+                lane[k] = i;
+            }
+        }
+    }
+
+    // calls f with every live ball low enough and close enough to touch the paddle,
+    // or to have touched it on the way to at most below under it and side beside it
+    template <typename F>
+    void forEachPaddleCandidate(const sf::RectangleShape& paddle, float below, float side, F f) const {
+        sf::Vector2f position = paddle.getPosition();
+        sf::Vector2f size = paddle.getSize();
+        float radius = _prototype.radius;
+        unsigned int first = laneAt(position.x - radius - side);
+        unsigned int last = laneAt(position.x + size.x + radius + side);
+        for (unsigned int lane = first; lane <= last; ++lane) {
+            for (unsigned int i : _lanes[lane]) {
+                float y = _slots[i]->ball.getPosition().y;
+                // already past the paddle
+                if (y - radius > position.y + size.y + below) continue;
+                // this one and everything above it are still too high
+                if (y + radius < position.y) break;
+                f(i);
             }
         }
     }
 
+    void addChunk(unsigned int count) {
+        _chunks.emplace_back(new T[count]);
+        T* chunk = _chunks.back().get();
+        for (unsigned int i = 0; i < count; ++i) {
+            chunk[i] = _prototype;
+            _free.push_back(_slots.size());
+            _slots.push_back(&chunk[i]);
+            _laneOf.push_back(0);
+            _liveIndex.push_back(0);
+        }
+        _live.reserve(_slots.size());
+        _free.reserve(_slots.size());
+    }
+
+    bool grow() {
+        if (_slots.size() >= _maxCapacity) {
+            return false;
+        }
+        addChunk(std::min<unsigned int>(_slots.size(), _maxCapacity - _slots.size()));
+        _stats.growthEvents++;
+        return true;
+    }
+
+    T _prototype;
+    std::vector<std::unique_ptr<T[]>> _chunks;
+    std::vector<T*> _slots;
+    std::vector<unsigned int> _live;
+    std::vector<unsigned int> _free;
+    // per slot: its lane, and its place in _live while it's alive
+    std::vector<unsigned int> _laneOf;
+    std::vector<unsigned int> _liveIndex;
+    float _laneWidth{1.f};
+    std::vector<std::vector<unsigned int>> _lanes;
+    std::vector<unsigned int> _hits;
+    unsigned int _maxCapacity{0};
+    PoolStats _stats;
+};
+
+// the plain falling balls
+using BallPool = EntityPool<BallEntity, FallingBehavior>;
+
+// the balls of BallPool without the per-tick integration. balls never accelerate, so a
+// ball is just its spawn time, x and speed, and its y is worked out when someone asks.
+// when it reaches the paddle's height and when it leaves the screen are known at spawn
+// and go in a queue; a tick pops the events due and tests only the balls beside the
+// paddle, so its cost doesn't grow with the number of balls on screen
+class AnalyticBallPool {
+public:
+    rng::Pcg32 spawnRng;
+    // where despawns are reported for effects; null when nothing is drawn
+    std::vector<DespawnEvent>* despawnEvents{nullptr};
+    float minSpeed{default_vals::balls::min_speed};
+    float maxSpeed{default_vals::balls::max_speed};
+
+    // starts with capacity slots and doubles up to max_capacity, like BallPool
+    void initialize(float xb, float yb, float radius, float paddleTop, const sf::Color& c,
+            unsigned int capacity, unsigned int max_capacity) {
+        x_bound = xb;
+        y_bound = yb;
+        _radius = radius;
+        _paddleTop = paddleTop;
+        _color = c;
+        _scratch.radius = radius;
+        _scratch.initializeEntity(-radius, -radius);
+        _maxCapacity = std::max(capacity, max_capacity);
+        _x.clear();
+        _speed.clear();
+        _spawnTime.clear();
+        _generation.clear();
+        _liveIndex.clear();
+        _bandIndex.clear();
+        _stats = PoolStats();
+        addSlots(capacity);
+        reset();
+    }
+
+    void reset() {
+        _now = 0.0;
+        _events = decltype(_events)();
+        _live.clear();
+        _band.clear();
+        _free.clear();
+        for (unsigned int i = _x.size(); i-- > 0;) {
+            _generation[i]++;
+            _bandIndex[i] = not_in_band;
+            _free.push_back(i);
+        }
+    }
+
+    void spawnBatch(const std::vector<SpawnRequest>& batch, sf::Time now) {
+        for (const SpawnRequest& request : batch) {
+            spawnBall(request.xMin, request.xMax, (now - request.time).asSeconds());
+        }
+    }
+
+    // draws the same numbers as BallPool::spawnBall, in the same order
+    bool spawnBall(float x_min, float x_max, float age) {
+        if (_free.empty() && !grow()) {
+            _stats.spawnFailures++;
+            return false;
+        }
+        unsigned int i = _free.back();
+        _free.pop_back();
+        int gen_x = spawnRng.range(x_min, x_max);
+        float gen_v = spawnRng.uniform(minSpeed, maxSpeed);
+        if (gen_x - _radius < 0)
+            gen_x = _radius;
+        if (gen_x + _radius > x_bound)
+            gen_x = x_bound - _radius;
+        _x[i] = gen_x;
+        _speed[i] = std::max(gen_v, epsilon);
+        _spawnTime[i] = _now - age;
+        _liveIndex[i] = _live.size();
+        _live.push_back(i);
+        // y = radius + speed * (t - spawn time); solve for the paddle's top and the bottom edge.
+        // the first is a little early to be safe, the paddle test itself is exact
+        _events.push({_spawnTime[i] + (_paddleTop - 2.f * _radius) / _speed[i] - 1e-4, i, _generation[i], false});
+        _events.push({_spawnTime[i] + (y_bound - 2.f * _radius) / _speed[i], i, _generation[i], true});
+        _stats.peakLive = std::max<unsigned int>(_stats.peakLive, _live.size());
+        return true;
+    }
+
+    // same order and the same swept paddle test as BallPool::tick: balls leave the
+    // screen first, for points unless they crossed the paddle on the way, then the
+    // ones still beside the paddle are tested against it
+    TickResult tick(float delta, const sf::RectangleShape& paddle, const sf::Vector2f& paddleShift) {
+        TickResult result;
+        _now += delta;
+        int exitHits = 0;
+        while (!_events.empty() && _events.top().time <= _now) {
+            Event event = _events.top();
+            _events.pop();
+            unsigned int i = event.slot;
+            // the ball already hit the paddle
+            if (event.generation != _generation[i]) continue;
+            if (event.exit) {
+                // leaving needs y + radius > y_bound, touching it isn't enough
+                if (yOf(i) + _radius <= y_bound) {
+                    _events.push({std::nextafter(_now, 1e300), i, event.generation, true});
+                    continue;
+                }
+                bool hit = sweptHit(i, delta, paddle, paddleShift);
+                if (hit) {
+                    exitHits++;
+                } else {
+                    result.score += FallingBehavior::exit_score;
+                }
+                report(i, hit);
+                despawn(i);
+                result.despawns++;
+            } else {
+                _bandIndex[i] = _band.size();
+                _band.push_back(i);
+            }
+        }
+
+        _hits.clear();
+        for (unsigned int i : _band) {
+            if (sweptHit(i, delta, paddle, paddleShift)) {
+                _hits.push_back(i);
+            }
+        }
+        for (unsigned int i : _hits) {
+            report(i, true);
+            despawn(i);
+        }
+        result.hits = FallingBehavior::hit_damage * (exitHits + static_cast<int>(_hits.size()));
+        result.despawns += _hits.size();
+        return result;
+    }
+
+    // whether ball i touched the paddle between the last tick and this one
+    bool sweptHit(unsigned int i, float delta, const sf::RectangleShape& paddle, const sf::Vector2f& paddleShift) const {
+        sf::Vector2f paddleStart = paddle.getPosition() - paddleShift;
+        sf::FloatRect bounds(paddleStart.x, paddleStart.y, paddle.getSize().x, paddle.getSize().y);
+        sf::Vector2f start(_x[i], _radius + _speed[i] * static_cast<float>(_now - delta - _spawnTime[i]));
+        sf::Vector2f moved(0.f, _speed[i] * delta);
+        return sweptCircleRectTime(start, moved - paddleShift, _radius, bounds) <= 1.f;
+    }
+
+    float yOf(unsigned int i) const {
+        return _radius + _speed[i] * static_cast<float>(_now - _spawnTime[i]);
+    }
+
+    void drawVisibleBalls(BallBatchRenderer& batch) {
+        for (unsigned int i : _live) {
+            batch.add(sf::Vector2f(_x[i], yOf(i)), _radius, _color);
+        }
+    }
+
+    // for the bots, which read BallEntity; one scratch entity is filled in per ball
+    template <typename F>
+    void forEachLive(F f) {
+        for (unsigned int i : _live) {
+            _scratch.ball.setPosition(_x[i], yOf(i));
+            _scratch.velocity = sf::Vector2f(0.f, _speed[i]);
+            f(static_cast<const BallEntity&>(_scratch));
+        }
+    }
+
+    unsigned int capacity() const {
+        return _x.size();
+    }
+
+    const PoolStats& stats() const {
+        return _stats;
+    }
+
+    float x_bound{0.f};
+    float y_bound{0.f};
+
 private:
-    static const unsigned int _pool_size{200};
-    BallEntity _ballPool[_pool_size];
+    static constexpr unsigned int not_in_band{std::numeric_limits<unsigned int>::max()};
+
+    struct Event {
+        double time;
+        unsigned int slot;
+        // events of a ball that has since despawned are skipped
+        unsigned int generation;
+        bool exit;
+
+        bool operator>(const Event& other) const {
+            return time > other.time;
+        }
+    };
+
+    void report(unsigned int i, bool hit) {
+        if (despawnEvents) despawnEvents->push_back({sf::Vector2f(_x[i], yOf(i)), _color, hit});
+    }
+
+    void despawn(unsigned int i) {
+        unsigned int k = _liveIndex[i];
+        _live[k] = _live.back();
+        _liveIndex[_live[k]] = k;
+        _live.pop_back();
+        if (_bandIndex[i] != not_in_band) {
+            unsigned int b = _bandIndex[i];
+            _band[b] = _band.back();
+            _bandIndex[_band[b]] = b;
+            _band.pop_back();
+            _bandIndex[i] = not_in_band;
+        }
+        _generation[i]++;
+        _free.push_back(i);
+    }
+
+    void addSlots(unsigned int count) {
+        for (unsigned int k = 0; k < count; ++k) {
+            _free.push_back(_x.size());
+            _x.push_back(0.f);
+            _speed.push_back(0.f);
+            _spawnTime.push_back(0.0);
+            _generation.push_back(0);
+            _liveIndex.push_back(0);
+            _bandIndex.push_back(not_in_band);
+        }
+        _live.reserve(_x.size());
+        _free.reserve(_x.size());
+    }
+
+    bool grow() {
+        if (_x.size() >= _maxCapacity) {
+            return false;
+        }
+        addSlots(std::min<unsigned int>(_x.size(), _maxCapacity - _x.size()));
+        _stats.growthEvents++;
+        return true;
+    }
+
+    float _radius{0.f};
+    float _paddleTop{0.f};
+    double _now{0.0};
+    sf::Color _color;
+    BallEntity _scratch;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _events;
+    // per slot
+    std::vector<float> _x;
+    std::vector<float> _speed;
+    std::vector<double> _spawnTime;
+    std::vector<unsigned int> _generation;
+    std::vector<unsigned int> _liveIndex;
+    std::vector<unsigned int> _bandIndex;
+    std::vector<unsigned int> _live;
+    // live balls low enough to touch the paddle
+    std::vector<unsigned int> _band;
+    std::vector<unsigned int> _free;
+    std::vector<unsigned int> _hits;
+    unsigned int _maxCapacity{0};
+    PoolStats _stats;
 };
 
-// enumerations
-enum Direction {up, down, left, right};
+// a spawn pattern: the steady stream, or a scripted wave from project_waves.txt.
+// a burst drops count balls at once, a lane spawns every period for duration seconds,
+// and a ramp does the same while its period slides from period to end_period
+struct Wave {
+    enum Kind {burst, lane, ramp};
+    Kind kind{lane};
+    sf::Time start;
+    // zero means it never ends
+    sf::Time duration;
+    float period{1.f};
+    float endPeriod{1.f};
+    unsigned int count{0};
+    float xMin{0.f};
+    float xMax{0.f};
+    sf::Time next;
+    bool done{false};
 
-// globals
-unsigned int window_w{default_vals::window_w};
-unsigned int window_h{default_vals::window_h};
+    sf::Time periodAt(sf::Time t) const {
+        float p = period;
+        if (kind == ramp && duration > sf::Time::Zero) {
+            float f = utility::clamp((t - start).asSeconds() / duration.asSeconds(), 0.f, 1.f);
+            p = period + (endPeriod - period) * f;
+        }
+        return std::max(sf::microseconds(1), sf::seconds(p));
+    }
+};
 
-bool directionFlags[4] = {false, false, false, false};
-bool leftMouseButtonFlag = false;
+// reads the scripted waves; the steady stream is not one of them
+bool readWaves(const std::string& fileName, std::vector<Wave>& scripted) {
+    std::ifstream waves(fileName);
+    if (!waves.is_open()) return false;
+    std::string kind;
+    while (waves >> kind) {
+        Wave wave;
+        float start, duration{0.f};
+        if (kind == "burst") {
+            wave.kind = Wave::burst;
+            waves >> start >> wave.count >> wave.xMin >> wave.xMax;
+        } else if (kind == "lane") {
+            wave.kind = Wave::lane;
+            waves >> start >> duration >> wave.period >> wave.xMin >> wave.xMax;
+            wave.endPeriod = wave.period;
+        } else if (kind == "ramp") {
+            wave.kind = Wave::ramp;
+            waves >> start >> duration >> wave.period >> wave.endPeriod >> wave.xMin >> wave.xMax;
+        } else {
+            std::cout << "unknown wave kind " << kind << "\n";
+            break;
+        }
+        if (!waves) break;
+        if (wave.kind != Wave::burst && (wave.period <= 0.f || wave.endPeriod <= 0.f || duration <= 0.f)) {
+            std::cout << "skipping " << kind << " wave: its periods and duration must be positive\n";
+            continue;
+        }
+        if (wave.xMin > wave.xMax) {
+            std::cout << "skipping " << kind << " wave: x_min is past x_max\n";
+            continue;
+        }
+        wave.start = wave.next = sf::seconds(start);
+        wave.duration = sf::seconds(duration);
+        scripted.push_back(wave);
+    }
+    return true;
+}
+
+// turns the waves into spawn requests on the game clock. every spawn that comes due
+// during a step is emitted, however many there are, so a hitch never loses any
+class SpawnScheduler {
+public:
+    sf::Time now;
+
+    // a zero period leaves the steady stream out
+    void reset(sf::Time period, float width, const std::vector<Wave>& scripted) {
+        now = sf::Time::Zero;
+        _waves.clear();
+        if (period > sf::Time::Zero) {
+            Wave steady;
+            steady.start = period;
+            steady.period = steady.endPeriod = period.asSeconds();
+            steady.xMax = width;
+            steady.next = steady.start;
+            _waves.push_back(steady);
+        }
+        _waves.insert(_waves.end(), scripted.begin(), scripted.end());
+    }
+
+    // fills batch with the spawns due in (now, now + delta], oldest first
+    void advance(sf::Time delta, std::vector<SpawnRequest>& batch) {
+        batch.clear();
+        sf::Time end = now + delta;
+        for (Wave& wave : _waves) {
+            while (!wave.done && wave.next <= end) {
+                if (wave.kind == Wave::burst) {
+                    batch.insert(batch.end(), wave.count, SpawnRequest{wave.next, wave.xMin, wave.xMax});
+                    wave.done = true;
+                } else if (wave.duration > sf::Time::Zero && wave.next >= wave.start + wave.duration) {
+                    wave.done = true;
+                } else {
+                    batch.push_back({wave.next, wave.xMin, wave.xMax});
+                    wave.next += wave.periodAt(wave.next);
+                }
+            }
+        }
+        std::stable_sort(batch.begin(), batch.end(), [](const SpawnRequest& a, const SpawnRequest& b) {
+            return a.time < b.time;
+        });
+        now = end;
+    }
+
+private:
+    std::vector<Wave> _waves;
+};
+
+// enumerations
+enum Direction {up, down, left, right};
 
 struct PaddleProperties {
     float width{default_vals::user::width};
@@ -233,35 +949,303 @@ struct BallProperties {
     float radius{default_vals::balls::radius};
     sf::Time ballGenerationPeriod = default_vals::balls::ballGenerationPeriod;
     sf::Color color = default_vals::balls::color;
+    float minSpeed{default_vals::balls::min_speed};
+    float maxSpeed{default_vals::balls::max_speed};
+    unsigned int poolCapacity{default_vals::balls::pool_capacity};
+    unsigned int poolMaxCapacity{default_vals::balls::pool_max_capacity};
+    sf::Time powerUpPeriod = default_vals::kinds::power_up_period;
+    sf::Time bombPeriod = default_vals::kinds::bomb_period;
+    sf::Time homingPeriod = default_vals::kinds::homing_period;
+};
+
+// everything project_settings.txt and project_waves.txt describe
+struct GameSettings {
+    unsigned int window_w{default_vals::window_w};
+    unsigned int window_h{default_vals::window_h};
+    PaddleProperties paddleProps;
+    BallProperties ballProps;
+    std::vector<Wave> waves;
+    // --analytic: AnalyticBallPool instead of BallPool
+    bool analytic{false};
+    // report despawns for the particle effects
+    bool effects{false};
+};
+
+// one running game. everything a step reads or writes lives here, so the tuner can
+// run one per thread
+struct Game {
+    float width{0.f};
+    float height{0.f};
+    unsigned int score{0};
+    PaddleProperties paddleProps;
+    BallProperties ballProps;
+    sf::RectangleShape paddle;
+    BallPool ballPool;
+    AnalyticBallPool analyticPool;
+    bool analytic{false};
+    EntityPool<BallEntity, PowerUpBehavior> powerUps;
+    EntityPool<BallEntity, BombBehavior> bombs;
+    EntityPool<BallEntity, HomingBehavior> homingBalls;
+    int maxHealth{0};
+    // this step's despawns, if the settings asked for effects
+    std::vector<DespawnEvent> despawns;
+    SpawnScheduler spawnScheduler;
+    SpawnScheduler powerUpScheduler;
+    SpawnScheduler bombScheduler;
+    SpawnScheduler homingScheduler;
+    std::vector<SpawnRequest> spawnBatch;
+    rng::Service rng;
+    bool directionFlags[4] = {false, false, false, false};
+
+    bool initialize(const GameSettings& settings) {
+        width = settings.window_w;
+        height = settings.window_h;
+        score = 0;
+        paddleProps = settings.paddleProps;
+        maxHealth = paddleProps.health_points;
+        ballProps = settings.ballProps;
+        std::fill(directionFlags, directionFlags + 4, false);
+
+        paddle.setSize(sf::Vector2f(paddleProps.width, paddleProps.height));
+        paddle.setPosition(width / 2.f - paddleProps.width / 2.f, height - paddleProps.height - 15.f);
+        paddle.setFillColor(sf::Color::White);
+        bool initSuccess = ballPool.initializeBallPool(width, height, ballProps.radius, sf::Color::Red, zero_vector,
+            ballProps.poolCapacity, ballProps.poolMaxCapacity);
+        if (!initSuccess) {
+            return false;
+        }
+        ballPool.minSpeed = ballProps.minSpeed;
+        ballPool.maxSpeed = ballProps.maxSpeed;
+        analytic = settings.analytic;
+        if (analytic) {
+            analyticPool.initialize(width, height, ballProps.radius, paddle.getPosition().y, sf::Color::Red,
+                ballProps.poolCapacity, ballProps.poolMaxCapacity);
+            analyticPool.minSpeed = ballProps.minSpeed;
+            analyticPool.maxSpeed = ballProps.maxSpeed;
+        }
+        spawnScheduler.reset(ballProps.ballGenerationPeriod, width, settings.waves);
+
+        namespace kinds = default_vals::kinds;
+        unsigned int max_capacity = std::max(kinds::pool_capacity, ballProps.poolMaxCapacity);
+        if (!powerUps.initializeBallPool(width, height, ballProps.radius * kinds::power_up_scale, kinds::power_up_color,
+                zero_vector, kinds::pool_capacity, max_capacity) ||
+            !bombs.initializeBallPool(width, height, ballProps.radius * kinds::bomb_scale, kinds::bomb_color,
+                zero_vector, kinds::pool_capacity, max_capacity) ||
+            !homingBalls.initializeBallPool(width, height, ballProps.radius * kinds::homing_scale, kinds::homing_color,
+                zero_vector, kinds::pool_capacity, max_capacity)) {
+            return false;
+        }
+        forEachExtraPool([&](auto& pool) {
+            pool.minSpeed = ballProps.minSpeed;
+            pool.maxSpeed = ballProps.maxSpeed;
+        });
+        despawns.clear();
+        std::vector<DespawnEvent>* sink = settings.effects ? &despawns : nullptr;
+        ballPool.despawnEvents = sink;
+        analyticPool.despawnEvents = sink;
+        forEachExtraPool([&](auto& pool) {
+            pool.despawnEvents = sink;
+        });
+        powerUpScheduler.reset(ballProps.powerUpPeriod, width, {});
+        bombScheduler.reset(ballProps.bombPeriod, width, {});
+        homingScheduler.reset(ballProps.homingPeriod, width, {});
+        return true;
+    }
+
+    void seed(std::uint64_t s) {
+        rng.seed(s);
+        ballPool.spawnRng = rng.stream(rng_streams::spawns);
+        analyticPool.spawnRng = rng.stream(rng_streams::spawns);
+        powerUps.spawnRng = rng.stream(rng_streams::power_ups);
+        bombs.spawnRng = rng.stream(rng_streams::bombs);
+        homingBalls.spawnRng = rng.stream(rng_streams::homing);
+    }
+
+    // the pools besides the plain balls, one after another
+    template <typename F>
+    void forEachExtraPool(F f) {
+        f(powerUps);
+        f(bombs);
+        f(homingBalls);
+    }
+
+    // every pool in use, plain balls first
+    template <typename F>
+    void forEachPool(F f) {
+        if (analytic) f(analyticPool);
+        else f(ballPool);
+        forEachExtraPool(f);
+    }
+
+    // every live entity that hurts on contact; power-ups are left out
+    template <typename F>
+    void forEachLive(F f) {
+        if (analytic) analyticPool.forEachLive(f);
+        else ballPool.forEachLive(f);
+        bombs.forEachLive(f);
+        homingBalls.forEachLive(f);
+    }
+
+    template <typename Pool>
+    void spawnInto(Pool& pool, SpawnScheduler& scheduler, const sf::Time& elapsed) {
+        scheduler.advance(elapsed, spawnBatch);
+        pool.spawnBatch(spawnBatch, scheduler.now);
+    }
+
+    // note: if it's instantaneous acceleration, use a local variable instead
+    // build with -DREFERENCE_TICK to run the separate passes instead of BallPool::tick
+    void update(const sf::Time& elapsed) {
+        float delta = elapsed.asSeconds();
+
+        // move paddle
+        sf::Vector2f paddle_v;
+        if (directionFlags[static_cast<unsigned int>(Direction::left)]) paddle_v.x -= paddleProps.speed;
+        if (directionFlags[static_cast<unsigned int>(Direction::right)]) paddle_v.x += paddleProps.speed;
+        sf::Vector2f paddleStart = paddle.getPosition();
+        paddle.move(paddle_v * delta);
+        // keep the paddle inside the window
+        float paddle_x = std::max(0.f, std::min(paddle.getPosition().x, width - paddleProps.width));
+        paddle.setPosition(paddle_x, paddle.getPosition().y);
+        sf::Vector2f paddleShift = paddle.getPosition() - paddleStart;
+
+#ifdef REFERENCE_TICK
+        // move existing balls
+        ballPool.updateAllBallsInBound(delta, score);
+
+        // count collisions
+        int collisions = ballPool.ballsCollidingWith(paddle);
+        ballPool.resetBallsOnCollision(paddle);
+#else
+        TickResult result = analytic ? analyticPool.tick(delta, paddle, paddleShift) : ballPool.tick(delta, paddle, paddleShift);
+        score += result.score;
+        int collisions = result.hits;
+#endif
+        forEachExtraPool([&](auto& pool) {
+            TickResult extra = pool.tick(delta, paddle, paddleShift);
+            score += extra.score;
+            collisions += extra.hits;
+        });
+        // collisions is the HP lost; power-ups make it negative, up to the starting HP
+        paddleProps.health_points = utility::clamp(paddleProps.health_points - collisions, 0, maxHealth);
+
+        // new entities come in after the tick, already moved to where this step ends
+        if (analytic) spawnInto(analyticPool, spawnScheduler, elapsed);
+        else spawnInto(ballPool, spawnScheduler, elapsed);
+        spawnInto(powerUps, powerUpScheduler, elapsed);
+        spawnInto(bombs, bombScheduler, elapsed);
+        spawnInto(homingBalls, homingScheduler, elapsed);
+    }
 };
 
-PaddleProperties paddleProps;
-sf::RectangleShape user_paddle;
-BallProperties ballProps;
-BallPool ballPool;
+// globals
+bool leftMouseButtonFlag = false;
+bool headless = false;
+// per-step inputs, written with --record and played back by --headless
+std::ofstream inputRecord;
+// --ai: PaddleAI plays instead of the keyboard
+bool aiPlayer = false;
+std::uint64_t master_seed{0};
+GameSettings gameSettings;
+Game game;
 
-struct TextObject {
+// the HP and score text. values are formatted into a fixed buffer, and the text is
+// only laid out again when one of them changed, at most once per rendered frame
+struct Hud {
     sf::Font font;
     sf::Text text;
+
+    void setHealth(int hp) {
+        if (hp != _hp) {
+            _hp = hp;
+            _dirty = true;
+        }
+    }
+
+    void setScore(unsigned int s) {
+        if (s != _score) {
+            _score = s;
+            _dirty = true;
+        }
+    }
+
+    void refresh() {
+        if (!_dirty) return;
+        char* out = _buffer;
+        out = append(out, "HP: ");
+        out = appendNumber(out, _hp);
+        out = append(out, "\nScore: ");
+        out = appendNumber(out, _score);
+        out = append(out, "\nAvoid the falling balls!");
+        *out = '\0';
+        text.setString(_buffer);
+        _dirty = false;
+    }
+
+private:
+    static char* append(char* out, const char* s) {
+        while (*s) *out++ = *s++;
+        return out;
+    }
+
+    static char* appendNumber(char* out, long long value) {
+        if (value < 0) {
+            *out++ = '-';
+            value = -value;
+        }
+        char digits[20];
+        int count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+        while (count > 0) *out++ = digits[--count];
+        return out;
+    }
+
+    int _hp{0};
+    unsigned int _score{0};
+    bool _dirty{true};
+    // both labels, an 11-character int, a 10-digit unsigned and the tagline fit
+    char _buffer[64];
 };
 
-TextObject textObject;
+Hud hud;
+// every live ball in one draw call
+BallBatchRenderer ballRenderer;
+ParticleSystem particles;
 
 bool readFromAvailableText() {
     std::string input;
     std::ifstream settings("project_settings.txt");
     if (settings.is_open()) {
         int r, g, b;
-        settings >> window_w >> window_h;
-        settings >> paddleProps.width >> paddleProps.height >> paddleProps.speed >> paddleProps.health_points;
+        settings >> gameSettings.window_w >> gameSettings.window_h;
+        settings >> gameSettings.paddleProps.width >> gameSettings.paddleProps.height >> gameSettings.paddleProps.speed >> gameSettings.paddleProps.health_points;
         settings >> r >> g >> b;
         r %= 256; g %= 256; b %= 256;
-        paddleProps.color = sf::Color(r,g,b);
-        settings >> ballProps.radius;
+        gameSettings.paddleProps.color = sf::Color(r,g,b);
+        settings >> gameSettings.ballProps.radius;
         settings >> r >> g >> b;
         r %= 256; g %= 256; b %= 256;
-        ballProps.color = sf::Color(r,g,b);
+        gameSettings.ballProps.color = sf::Color(r,g,b);
         settings >> fontFileName >> fontSize;
+        unsigned int capacity, max_capacity;
+        if (settings >> capacity >> max_capacity) {
+            gameSettings.ballProps.poolCapacity = capacity;
+            gameSettings.ballProps.poolMaxCapacity = max_capacity;
+        }
+        settings >> master_seed;
+        float min_speed, max_speed;
+        if (settings >> min_speed >> max_speed) {
+            gameSettings.ballProps.minSpeed = min_speed;
+            gameSettings.ballProps.maxSpeed = max_speed;
+        }
+        float power_up_period, bomb_period, homing_period;
+        if (settings >> power_up_period >> bomb_period >> homing_period) {
+            gameSettings.ballProps.powerUpPeriod = sf::seconds(power_up_period);
+            gameSettings.ballProps.bombPeriod = sf::seconds(bomb_period);
+            gameSettings.ballProps.homingPeriod = sf::seconds(homing_period);
+        }
         settings.close();
         return true;
     } else {
@@ -269,33 +1253,38 @@ bool readFromAvailableText() {
     }
 }
 
+void seedGame(std::uint64_t seed) {
+    game.seed(seed);
+    game.rng.logSeed(std::cout);
+}
+
 bool initializeSettings() {
     if (readFromAvailableText()) {
         std::cout << "project_settings.txt successfully loaded.\n";
     } else {
         std::cout << "project_settings.txt not loaded. Using default values.\n";    
     }
+    if (readWaves("project_waves.txt", gameSettings.waves)) {
+        std::cout << "project_waves.txt loaded, " << gameSettings.waves.size() << " waves.\n";
+    }
+    gameSettings.effects = !headless;
 
-    if (!textObject.font.loadFromFile(fontFileName)) {
+    if (!game.initialize(gameSettings)) {
         return false;
     }
-    textObject.text.setString(
-        "HP: " + std::to_string(paddleProps.health_points) + 
-        "\nScore: " + std::to_string(score) +
-        "\nAvoid the falling balls!"
-        );
-    textObject.text.setFont(textObject.font);
-    textObject.text.setCharacterSize(fontSize);
-
-    sf::Vector2f rectSize{paddleProps.width, paddleProps.height};
-    user_paddle.setSize(rectSize);
-    user_paddle.setPosition(window_w / 2.f - paddleProps.width / 2.f, window_h - paddleProps.height - 15.f);
-    user_paddle.setFillColor(sf::Color::White);
-    bool initSuccess = ballPool.initializeBallPool(window_w, window_h, ballProps.radius, sf::Color::Red, zero_vector);
-    if (!initSuccess) {
-        return false;
+
+    // a headless run never draws, so it doesn't need the font or the ball texture
+    if (!headless) {
+        if (!hud.font.loadFromFile(fontFileName) || !ballRenderer.initialize()) {
+            return false;
+        }
+        particles.initialize(default_vals::particles::capacity, default_vals::particles::burst_capacity);
+        hud.text.setFont(hud.font);
+        hud.text.setCharacterSize(fontSize);
+        hud.setHealth(game.paddleProps.health_points);
+        hud.setScore(game.score);
+        hud.refresh();
     }
-    ballPool.resetAllBalls();
 
     return true;
 }
@@ -306,16 +1295,16 @@ void pressEvents(sf::RenderWindow& window, const sf::Event& event) {
             window.close();
             break;
         case sf::Keyboard::W:
-            directionFlags[static_cast<unsigned int>(Direction::up)] = true;
+            game.directionFlags[static_cast<unsigned int>(Direction::up)] = true;
             break;
         case sf::Keyboard::A:
-            directionFlags[static_cast<unsigned int>(Direction::left)] = true;
+            game.directionFlags[static_cast<unsigned int>(Direction::left)] = true;
             break;
         case sf::Keyboard::S:
-            directionFlags[static_cast<unsigned int>(Direction::down)] = true;
+            game.directionFlags[static_cast<unsigned int>(Direction::down)] = true;
             break;
         case sf::Keyboard::D:
-            directionFlags[static_cast<unsigned int>(Direction::right)] = true;
+            game.directionFlags[static_cast<unsigned int>(Direction::right)] = true;
             break;
         default:
             // nothing
@@ -326,16 +1315,16 @@ void pressEvents(sf::RenderWindow& window, const sf::Event& event) {
 void releaseEvents(sf::RenderWindow& window, const sf::Event& event) {
     switch (event.key.code) {
         case sf::Keyboard::W:
-            directionFlags[static_cast<unsigned int>(Direction::up)] = false;
+            game.directionFlags[static_cast<unsigned int>(Direction::up)] = false;
             break;
         case sf::Keyboard::A:
-            directionFlags[static_cast<unsigned int>(Direction::left)] = false;
+            game.directionFlags[static_cast<unsigned int>(Direction::left)] = false;
             break;
         case sf::Keyboard::S:
-            directionFlags[static_cast<unsigned int>(Direction::down)] = false;
+            game.directionFlags[static_cast<unsigned int>(Direction::down)] = false;
             break;
         case sf::Keyboard::D:
-            directionFlags[static_cast<unsigned int>(Direction::right)] = false;
+            game.directionFlags[static_cast<unsigned int>(Direction::right)] = false;
             break;
         default:
             // nothing
@@ -369,71 +1358,609 @@ void handleInput(sf::RenderWindow& window) {
     }
 }
 
-// note: if it's instantaneous acceleration, use a local variable instead
 void update(const sf::Time& elapsed) {
-    float delta = elapsed.asSeconds();
-
-    // move paddle
-    sf::Vector2f paddle_v;
-    if (directionFlags[static_cast<unsigned int>(Direction::left)]) paddle_v.x -= paddleProps.speed;
-    if (directionFlags[static_cast<unsigned int>(Direction::right)]) paddle_v.x += paddleProps.speed;
-    user_paddle.move(paddle_v * delta);
-
-    // move existing balls
-    ballPool.updateAllBallsInBound(delta, score);
-
-    // count collisions
-    int collisions = ballPool.ballsCollidingWith(user_paddle);
-    ballPool.resetBallsOnCollision(user_paddle);
-    paddleProps.health_points -= collisions;
-    paddleProps.health_points = std::max(0, paddleProps.health_points);
-
-    textObject.text.setString(
-        "HP: " + std::to_string(paddleProps.health_points) + 
-        "\nScore: " + std::to_string(score) +
-        "\nAvoid the falling balls!"
-        );
+    game.update(elapsed);
+    hud.setHealth(game.paddleProps.health_points);
+    hud.setScore(game.score);
+}
+
+// a burst for every despawn since the last step: all around for a hit, a spray back
+// up for a ball leaving the screen. runs after game over too, so the last ones fade
+void updateEffects(const sf::Time& elapsed) {
+    const float pi = std::acos(-1.f);
+    for (const DespawnEvent& despawn : game.despawns) {
+        if (despawn.hit) {
+            particles.emit({despawn.position, despawn.color, default_vals::particles::hit_count, 0.f, pi});
+        } else {
+            particles.emit({despawn.position, despawn.color, default_vals::particles::exit_count, -pi / 2.f, pi / 4.f});
+        }
+    }
+    game.despawns.clear();
+    particles.update(elapsed.asSeconds());
 }
 
 void render(sf::RenderWindow& window) {
     window.clear(sf::Color::Black);
-    window.draw(user_paddle);
-    ballPool.drawVisibleBalls(window);
-    window.draw(textObject.text);
+    window.draw(game.paddle);
+    ballRenderer.clear();
+    game.forEachPool([](auto& pool) {
+        pool.drawVisibleBalls(ballRenderer);
+    });
+    ballRenderer.draw(window);
+    particles.draw(window);
+    hud.refresh();
+    window.draw(hud.text);
     window.display();
 }
 
-int main () {
-    srand(time(NULL));
-    sf::RenderWindow window(sf::VideoMode(window_w, window_h), "CS179.14A Final Project");
+void printPoolStats() {
+    const PoolStats& poolStats = game.analytic ? game.analyticPool.stats() : game.ballPool.stats();
+    unsigned int capacity = game.analytic ? game.analyticPool.capacity() : game.ballPool.capacity();
+    std::cout << (game.analytic ? "analytic " : "") << "ball pool: capacity " << capacity << ", peak live " << poolStats.peakLive
+              << ", spawn failures " << poolStats.spawnFailures << ", growth events " << poolStats.growthEvents << "\n";
+}
+
+// writes the direction flags the coming step will use, one line per fixed step
+void recordInputs() {
+    inputRecord << game.directionFlags[0] << ' ' << game.directionFlags[1] << ' '
+                << game.directionFlags[2] << ' ' << game.directionFlags[3] << '\n';
+}
+
+// plays a recorded game as fast as possible without a window. once the inputs run
+// out the paddle keeps its last state; max_ticks stops a game nobody can lose
+int runHeadless(std::uint64_t seed, const std::string& inputFileName, unsigned long max_ticks) {
+    headless = true;
+    if (!initializeSettings()) {
+        std::cout << "Initialization unsuccessful.\n";
+        return 1;
+    }
+    seedGame(seed);
+    std::ifstream inputs(inputFileName);
+    if (!inputs.is_open()) {
+        std::cout << inputFileName << " could not be opened.\n";
+        return 1;
+    }
+
+    std::vector<std::pair<unsigned long, int>> hpTimeline{{0, game.paddleProps.health_points}};
+    unsigned long ticks = 0;
+    sf::Clock clock;
+    while (game.paddleProps.health_points > 0 && ticks < max_ticks) {
+        int u, d, l, r;
+        if (inputs >> u >> d >> l >> r) {
+            game.directionFlags[static_cast<unsigned int>(Direction::up)] = u;
+            game.directionFlags[static_cast<unsigned int>(Direction::down)] = d;
+            game.directionFlags[static_cast<unsigned int>(Direction::left)] = l;
+            game.directionFlags[static_cast<unsigned int>(Direction::right)] = r;
+        }
+        update(fixed_update_time);
+        ++ticks;
+        if (game.paddleProps.health_points != hpTimeline.back().second) {
+            hpTimeline.push_back({ticks, game.paddleProps.health_points});
+        }
+    }
+    float seconds = clock.getElapsedTime().asSeconds();
+
+    std::cout << "headless: " << ticks << " ticks (" << ticks * fixed_update_time.asSeconds() << " s of game) in "
+              << seconds << " s, " << ticks / std::max(seconds, epsilon) << " ticks/s\n";
+    std::cout << "final score: " << game.score << ", HP " << game.paddleProps.health_points << "\n";
+    std::cout << "HP timeline (tick:HP):";
+    for (const std::pair<unsigned long, int>& change : hpTimeline) {
+        std::cout << ' ' << change.first << ':' << change.second;
+    }
+    std::cout << "\n";
+    printPoolStats();
+    return 0;
+}
+
+// bots for the tuner; each one sets the direction flags for the coming step
+// plans the paddle from where every ball will be. balls fall straight at a fixed
+// speed, so each one blocks a known range of paddle positions for a known time:
+// from when it drops to the paddle's top until it leaves the screen
+struct PaddleAI {
+    struct Threat {
+        float lo, hi;       // paddle x (left edge) values it would touch
+        float enter, exit;  // seconds from now
+    };
+
+    // how far ahead balls are taken into account
+    float horizon{2.f};
+    std::vector<Threat> threats;
+    std::vector<std::pair<float, int>> events;
+
+    // where the paddle should go this tick: the closest reachable x covered by the
+    // fewest threats, found by sweeping the sorted threat edges
+    float target(Game& g) {
+        float p0 = g.paddle.getPosition().x;
+        float top = g.paddle.getPosition().y;
+        float speed = std::max(g.paddleProps.speed, epsilon);
+        float max_x = g.width - g.paddleProps.width;
+        // one step of movement, since hits are only checked once per step
+        float margin = 1.f + speed * fixed_update_time.asSeconds();
+
+        threats.clear();
+        g.forEachLive([&](const BallEntity& entity) {
+            sf::Vector2f position = entity.ball.getPosition();
+            float vy = std::max(entity.velocity.y, epsilon);
+            Threat threat;
+            threat.enter = (top - entity.radius - position.y) / vy;
+            threat.exit = (g.height - entity.radius - position.y) / vy;
+            if (threat.exit < 0.f || threat.enter > horizon) return;
+            threat.lo = position.x - entity.radius - g.paddleProps.width - margin;
+            threat.hi = position.x + entity.radius + margin;
+            threats.push_back(threat);
+        });
+
+        // how far the paddle can run each way without driving through a ball on the way
+        float reach_lo = 0.f;
+        float reach_hi = max_x;
+        for (const Threat& threat : threats) {
+            if (threat.lo >= p0) {
+                float t_in = (threat.lo - p0) / speed;
+                float t_out = (threat.hi - p0) / speed;
+                if (t_in <= threat.exit && t_out >= threat.enter) reach_hi = std::min(reach_hi, threat.lo);
+            } else if (threat.hi <= p0) {
+                float t_in = (p0 - threat.hi) / speed;
+                float t_out = (p0 - threat.lo) / speed;
+                if (t_in <= threat.exit && t_out >= threat.enter) reach_lo = std::max(reach_lo, threat.hi);
+            }
+        }
+
+        // coverage over [reach_lo, reach_hi] by the threats still there when the paddle arrives
+        events.clear();
+        for (const Threat& threat : threats) {
+            float distance = std::max(0.f, std::max(threat.lo - p0, p0 - threat.hi));
+            if (threat.exit < distance / speed) continue;
+            if (threat.hi <= reach_lo || threat.lo >= reach_hi) continue;
+            events.push_back({std::max(threat.lo, reach_lo), 1});
+            events.push_back({threat.hi, -1});
+        }
+        std::sort(events.begin(), events.end());
+
+        float best = p0;
+        int bestCoverage = std::numeric_limits<int>::max();
+        float bestDistance = std::numeric_limits<float>::max();
+        float from = reach_lo;
+        int coverage = 0;
+        auto consider = [&](float to) {
+            float x = utility::clamp(p0, from, to);
+            float distance = std::abs(x - p0);
+            if (coverage < bestCoverage || (coverage == bestCoverage && distance < bestDistance)) {
+                best = x;
+                bestCoverage = coverage;
+                bestDistance = distance;
+            }
+            from = to;
+        };
+        for (const std::pair<float, int>& event : events) {
+            if (event.first >= reach_hi) break;
+            if (event.first > from) consider(event.first);
+            coverage += event.second;
+        }
+        consider(reach_hi);
+        return best;
+    }
+
+    // sets the direction flags the way a player would press the keys
+    void steer(Game& g) {
+        float p0 = g.paddle.getPosition().x;
+        float goal = target(g);
+        float deadband = g.paddleProps.speed * fixed_update_time.asSeconds() / 2.f;
+        g.directionFlags[static_cast<unsigned int>(Direction::left)] = goal < p0 - deadband;
+        g.directionFlags[static_cast<unsigned int>(Direction::right)] = goal > p0 + deadband;
+    }
+};
+
+enum class BotPolicy {idle, sweep, dodge, predict};
+
+bool parseBotPolicy(const std::string& name, BotPolicy& policy) {
+    if (name == "idle") policy = BotPolicy::idle;
+    else if (name == "sweep") policy = BotPolicy::sweep;
+    else if (name == "dodge") policy = BotPolicy::dodge;
+    else if (name == "predict") policy = BotPolicy::predict;
+    else return false;
+    return true;
+}
+
+void driveBot(Game& g, BotPolicy policy) {
+    bool& left = g.directionFlags[static_cast<unsigned int>(Direction::left)];
+    bool& right = g.directionFlags[static_cast<unsigned int>(Direction::right)];
+    float paddleLeft = g.paddle.getPosition().x;
+    float paddleRight = paddleLeft + g.paddleProps.width;
+    switch (policy) {
+        case BotPolicy::idle:
+            left = right = false;
+            break;
+        case BotPolicy::sweep:
+            // wall to wall
+            if (!left && !right) right = true;
+            if (right && paddleRight >= g.width) {
+                right = false;
+                left = true;
+            } else if (left && paddleLeft <= 0.f) {
+                left = false;
+                right = true;
+            }
+            break;
+        case BotPolicy::dodge: {
+            // step away from whichever ball near the paddle's columns lands first
+            float top = g.paddle.getPosition().y;
+            float margin = g.paddleProps.width / 2.f;
+            float soonest = std::numeric_limits<float>::max();
+            float threat_x = 0.f;
+            g.forEachLive([&](const BallEntity& entity) {
+                sf::Vector2f position = entity.ball.getPosition();
+                if (position.x + entity.radius < paddleLeft - margin || position.x - entity.radius > paddleRight + margin) return;
+                float eta = (top - position.y - entity.radius) / std::max(entity.velocity.y, epsilon);
+                if (eta >= 0.f && eta < soonest) {
+                    soonest = eta;
+                    threat_x = position.x;
+                }
+            });
+            left = right = false;
+            if (soonest < std::numeric_limits<float>::max()) {
+                bool goLeft = threat_x > (paddleLeft + paddleRight) / 2.f;
+                // cornered: run past it instead
+                if (goLeft && paddleLeft <= 0.f) goLeft = false;
+                else if (!goLeft && paddleRight >= g.width) goLeft = true;
+                left = goLeft;
+                right = !goLeft;
+            }
+            break;
+        }
+        case BotPolicy::predict: {
+            // only scratch space lives in here, one per tuner thread
+            static thread_local PaddleAI ai;
+            ai.steer(g);
+            break;
+        }
+    }
+}
+
+// one point of the tuner's parameter grid
+struct TuningPoint {
+    float period;
+    float radius;
+    float minSpeed;
+    float maxSpeed;
+    float paddleSpeed;
+};
+
+struct TuningResult {
+    float survivalSeconds;
+    unsigned int score;
+};
+
+// reads project_tuner.txt, one parameter and its values per line. a parameter that
+// isn't listed keeps its value from the settings; the grid is every combination
+void readTuningGrid(const std::string& fileName, std::vector<TuningPoint>& grid) {
+    std::vector<float> periods{gameSettings.ballProps.ballGenerationPeriod.asSeconds()};
+    std::vector<float> radii{gameSettings.ballProps.radius};
+    std::vector<sf::Vector2f> speedRanges{{gameSettings.ballProps.minSpeed, gameSettings.ballProps.maxSpeed}};
+    std::vector<float> paddleSpeeds{gameSettings.paddleProps.speed};
+
+    std::ifstream file(fileName);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream values(line);
+        std::string name;
+        if (!(values >> name)) continue;
+        float a, b;
+        if (name == "period" || name == "radius" || name == "paddle_speed") {
+            std::vector<float>& list = name == "period" ? periods : name == "radius" ? radii : paddleSpeeds;
+            list.clear();
+            while (values >> a) list.push_back(a);
+        } else if (name == "speed_range") {
+            speedRanges.clear();
+            while (values >> a >> b) speedRanges.push_back({a, b});
+        } else {
+            std::cout << "unknown tuning parameter " << name << "\n";
+        }
+    }
+
+    grid.clear();
+    for (float period : periods)
+        for (float radius : radii)
+            for (const sf::Vector2f& range : speedRanges)
+                for (float paddleSpeed : paddleSpeeds)
+                    grid.push_back({period, radius, range.x, range.y, paddleSpeed});
+}
+
+// value at quantile q of a sorted list
+template <typename T>
+T quantile(const std::vector<T>& sorted, float q) {
+    return sorted[std::min<std::size_t>(sorted.size() - 1, q * sorted.size())];
+}
+
+// plays games games per grid point with the bot on every core and reports how long
+// the paddle survived and what it scored. every worker builds its own Game, and
+// game i gets the same seed at every grid point so the settings face the same rain
+int runTuner(unsigned int games, BotPolicy policy, float max_seconds) {
+    headless = true;
+    if (!initializeSettings() || games == 0) {
+        std::cout << "Initialization unsuccessful.\n";
+        return 1;
+    }
+    std::vector<TuningPoint> grid;
+    readTuningGrid("project_tuner.txt", grid);
+    game.rng.seed(master_seed);
+    game.rng.logSeed(std::cout);
+    std::uint64_t baseSeed = game.rng.masterSeed;
+    unsigned long max_ticks = max_seconds / fixed_update_time.asSeconds();
+
+    std::vector<TuningResult> results(grid.size() * games);
+    std::atomic<unsigned int> nextJob{0};
+    auto worker = [&]() {
+        for (unsigned int job = nextJob++; job < results.size(); job = nextJob++) {
+            const TuningPoint& point = grid[job / games];
+            GameSettings settings = gameSettings;
+            settings.ballProps.ballGenerationPeriod = sf::seconds(point.period);
+            settings.ballProps.radius = point.radius;
+            settings.ballProps.minSpeed = point.minSpeed;
+            settings.ballProps.maxSpeed = point.maxSpeed;
+            settings.paddleProps.speed = point.paddleSpeed;
+
+            Game g;
+            if (!g.initialize(settings)) {
+                results[job] = {0.f, 0};
+                continue;
+            }
+            g.seed(baseSeed ^ (0x9E3779B97F4A7C15ull * (job % games + 1)));
+            unsigned long ticks = 0;
+            while (g.paddleProps.health_points > 0 && ticks < max_ticks) {
+                driveBot(g, policy);
+                g.update(fixed_update_time);
+                ++ticks;
+            }
+            results[job] = {ticks * fixed_update_time.asSeconds(), g.score};
+        }
+    };
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "tuning: " << grid.size() << " settings x " << games << " games on " << threadCount << " threads\n";
+    sf::Clock clock;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threadCount; ++t) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    std::cout << "done in " << clock.getElapsedTime().asSeconds() << " s\n";
+
+    std::ofstream csv("project_tuning.csv");
+    csv << "period,radius,min_speed,max_speed,paddle_speed,games,survived,"
+        << "survival_mean,survival_p10,survival_p50,survival_p90,score_mean,score_p10,score_p50,score_p90\n";
+    for (unsigned int p = 0; p < grid.size(); ++p) {
+        std::vector<float> survival;
+        std::vector<unsigned int> scores;
+        for (unsigned int i = p * games; i < (p + 1) * games; ++i) {
+            survival.push_back(results[i].survivalSeconds);
+            scores.push_back(results[i].score);
+        }
+        std::sort(survival.begin(), survival.end());
+        std::sort(scores.begin(), scores.end());
+        unsigned int survived = std::count_if(survival.begin(), survival.end(), [&](float t) {
+            return t >= max_ticks * fixed_update_time.asSeconds();
+        });
+        float survivalMean = std::accumulate(survival.begin(), survival.end(), 0.f) / games;
+        float scoreMean = std::accumulate(scores.begin(), scores.end(), 0.f) / games;
+
+        const TuningPoint& point = grid[p];
+        std::cout << "period " << point.period << " radius " << point.radius << " speed " << point.minSpeed << "-"
+                  << point.maxSpeed << " paddle " << point.paddleSpeed << ": survival mean " << survivalMean
+                  << " s (p10 " << quantile(survival, 0.1f) << ", p50 " << quantile(survival, 0.5f) << ", p90 "
+                  << quantile(survival, 0.9f) << "), " << survived << " reached the limit; score mean " << scoreMean
+                  << " (p50 " << quantile(scores, 0.5f) << ")\n";
+        csv << point.period << ',' << point.radius << ',' << point.minSpeed << ',' << point.maxSpeed << ','
+            << point.paddleSpeed << ',' << games << ',' << survived << ',' << survivalMean << ','
+            << quantile(survival, 0.1f) << ',' << quantile(survival, 0.5f) << ',' << quantile(survival, 0.9f) << ','
+            << scoreMean << ',' << quantile(scores, 0.1f) << ',' << quantile(scores, 0.5f) << ','
+            << quantile(scores, 0.9f) << '\n';
+    }
+    std::cout << "written to project_tuning.csv\n";
+    return 0;
+}
+
+// the plain-ball rules as an envs::Config, for the batched games
+envs::Config envConfig(const GameSettings& settings) {
+    envs::Config config;
+    config.width = settings.window_w;
+    config.height = settings.window_h;
+    config.paddleWidth = settings.paddleProps.width;
+    config.paddleHeight = settings.paddleProps.height;
+    config.paddleSpeed = settings.paddleProps.speed;
+    config.healthPoints = settings.paddleProps.health_points;
+    config.ballRadius = settings.ballProps.radius;
+    config.spawnPeriod = settings.ballProps.ballGenerationPeriod.asSeconds();
+    config.minSpeed = settings.ballProps.minSpeed;
+    config.maxSpeed = settings.ballProps.maxSpeed;
+    config.delta = fixed_update_time.asSeconds();
+    return config;
+}
+
+// steps count batched games with random actions for steps steps and reports env-steps
+// per second. each thread owns a contiguous block of games and its own action stream
+int runEnvBenchmark(unsigned int count, unsigned long steps) {
+    headless = true;
+    if (!initializeSettings() || count == 0) {
+        std::cout << "Initialization unsuccessful.\n";
+        return 1;
+    }
+    game.rng.seed(master_seed);
+    game.rng.logSeed(std::cout);
+    const BallProperties& props = gameSettings.ballProps;
+    if (props.powerUpPeriod > sf::Time::Zero || props.bombPeriod > sf::Time::Zero || props.homingPeriod > sf::Time::Zero) {
+        std::cout << "note: the batched games only have plain balls; power-ups, bombs and homing balls are left out\n";
+    }
+    envs::FallingBallEnvs batch(count, envConfig(gameSettings), game.rng.masterSeed);
+    std::vector<std::uint8_t> actions(count, envs::stay);
+
+    unsigned int threadCount = std::max(1u, std::min(count, std::thread::hardware_concurrency()));
+    std::vector<double> returns(threadCount, 0.0);
+    std::vector<unsigned long> episodes(threadCount, 0);
+    auto worker = [&](unsigned int t) {
+        unsigned int begin = count * t / threadCount;
+        unsigned int end = count * (t + 1) / threadCount;
+        rng::Pcg32 actionRng = game.rng.stream(rng_streams::actions + t);
+        for (unsigned long s = 0; s < steps; ++s) {
+            for (unsigned int e = begin; e < end; ++e) {
+                actions[e] = actionRng.below(3);
+            }
+            batch.stepRange(actions.data(), begin, end);
+            for (unsigned int e = begin; e < end; ++e) {
+                returns[t] += batch.rewards()[e];
+                episodes[t] += batch.dones()[e];
+            }
+        }
+    };
+    std::cout << "envs: " << count << " games x " << steps << " steps on " << threadCount << " threads\n";
+    sf::Clock clock;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threadCount; ++t) {
+        workers.emplace_back(worker, t);
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    float seconds = clock.getElapsedTime().asSeconds();
+    double totalReturn = std::accumulate(returns.begin(), returns.end(), 0.0);
+    unsigned long totalEpisodes = std::accumulate(episodes.begin(), episodes.end(), 0ul);
+    std::cout << "done in " << seconds << " s, " << count * steps / seconds / 1e6 << " million env-steps/s\n";
+    std::cout << totalEpisodes << " episodes finished, mean reward per step "
+              << totalReturn / (static_cast<double>(count) * steps) << "\n";
+    return 0;
+}
+
+// project_main --record <input file> plays normally and saves the inputs of every step
+// project_main --headless <seed> <input file> [max ticks] replays them without a window
+// project_main --tune [games per setting] [idle|sweep|dodge|predict] [max seconds] runs the tuner
+// project_main --ai [--record <input file>] lets PaddleAI play in the window
+// --analytic, before any of the above, runs the balls on AnalyticBallPool
+// project_main --envs [games] [steps] benchmarks the batched games in falling_ball_envs.hpp
+int usage() {
+    std::cout << "usage: project_main [--analytic] [--ai] [--record <input file>]\n"
+              << "       project_main [--analytic] --headless <seed> <input file> [max ticks]\n"
+              << "       project_main [--analytic] --tune [games per setting] [idle|sweep|dodge|predict] [max seconds]\n"
+              << "       project_main --envs [games] [steps]\n";
+    return 1;
+}
+
+// a whole command-line argument as a number no bigger than max. throws std::invalid_argument
+// or std::out_of_range otherwise, including for the minus sign and trailing junk that
+// std::stoull lets through
+unsigned long long parseCount(const std::string& arg, unsigned long long max) {
+    std::size_t used = 0;
+    unsigned long long value = std::stoull(arg, &used);
+    if (used != arg.size() || arg[0] == '-') throw std::invalid_argument(arg);
+    if (value > max) throw std::out_of_range(arg);
+    return value;
+}
+
+float parseSeconds(const std::string& arg) {
+    std::size_t used = 0;
+    float value = std::stof(arg, &used);
+    if (used != arg.size()) throw std::invalid_argument(arg);
+    return value;
+}
+
+int main (int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--analytic") {
+#ifdef REFERENCE_TICK
+        // the separate passes only exist for BallPool
+        std::cout << "--analytic doesn't work in a -DREFERENCE_TICK build\n";
+        return 1;
+#endif
+        gameSettings.analytic = true;
+        ++argv;
+        --argc;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--envs") {
+        if (gameSettings.analytic) {
+            std::cout << "--envs runs its own games, which have no AnalyticBallPool\n";
+            return usage();
+        }
+        unsigned int games = 4096;
+        unsigned long steps = 1000;
+        try {
+            if (argc > 2) games = parseCount(argv[2], std::numeric_limits<unsigned int>::max());
+            if (argc > 3) steps = parseCount(argv[3], std::numeric_limits<unsigned long>::max());
+        } catch (const std::logic_error&) {
+            return usage();
+        }
+        return runEnvBenchmark(games, steps);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--tune") {
+        unsigned int games = 1000;
+        BotPolicy policy = BotPolicy::dodge;
+        float max_seconds = 120.f;
+        if (argc > 3 && !parseBotPolicy(argv[3], policy)) {
+            std::cout << "unknown bot " << argv[3] << "\n";
+            return 1;
+        }
+        try {
+            if (argc > 2) games = parseCount(argv[2], std::numeric_limits<unsigned int>::max());
+            if (argc > 4) max_seconds = parseSeconds(argv[4]);
+        } catch (const std::logic_error&) {
+            return usage();
+        }
+        return runTuner(games, policy, max_seconds);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        if (argc < 4) {
+            return usage();
+        }
+        std::uint64_t seed;
+        unsigned long max_ticks = 144ul * 3600;
+        try {
+            seed = parseCount(argv[2], std::numeric_limits<std::uint64_t>::max());
+            if (argc > 4) max_ticks = parseCount(argv[4], std::numeric_limits<unsigned long>::max());
+        } catch (const std::logic_error&) {
+            return usage();
+        }
+        return runHeadless(seed, argv[3], max_ticks);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--ai") {
+        aiPlayer = true;
+        ++argv;
+        --argc;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--record") {
+        inputRecord.open(argv[2]);
+    }
+
+    sf::RenderWindow window(sf::VideoMode(gameSettings.window_w, gameSettings.window_h), "CS179.14A Final Project");
 	window.setFramerateLimit(fps_limit);
 
     if (!initializeSettings()) {
         std::cout << "Initialization unsuccessful.\n";
         return 0;
     }
+    seedGame(master_seed);
     
     sf::Clock clock;
     sf::Time timeSinceLastUpdate;
-    sf::Time timeSinceLastGeneration;
     while(window.isOpen()) {
         sf::Time elapsed = clock.restart();
         timeSinceLastUpdate += elapsed;
-        timeSinceLastGeneration += elapsed;
-
-        if (timeSinceLastGeneration >= ballProps.ballGenerationPeriod) {
-            if (paddleProps.health_points > 0)
-                ballPool.generateFallingBall();
-            timeSinceLastGeneration -= ballProps.ballGenerationPeriod;
-        }
 
         handleInput(window);
         while (timeSinceLastUpdate >= fixed_update_time) {
-            if (paddleProps.health_points > 0)
+            if (game.paddleProps.health_points > 0) {
+                if (aiPlayer) driveBot(game, BotPolicy::predict);
+                if (inputRecord.is_open()) recordInputs();
                 update(fixed_update_time);
+            }
+            updateEffects(fixed_update_time);
             timeSinceLastUpdate -= fixed_update_time;
         }
         render(window);
     }
+
+    if (inputRecord.is_open()) {
+        // the replay has to run on the same pool the game did
+        std::cout << "inputs recorded; replay with " << (gameSettings.analytic ? "--analytic " : "")
+                  << "--headless " << game.rng.masterSeed << " " << argv[2] << "\n";
+    }
+    printPoolStats();
     return 0;
+
 }
\ No newline at end of file
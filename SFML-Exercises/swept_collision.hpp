@@ -0,0 +1,59 @@
+#ifndef SWEPT_COLLISION_HPP
+#define SWEPT_COLLISION_HPP
+
+// continuous circle-rectangle test shared by project_main and the batched games in
+// falling_ball_envs.hpp; plain floats, so it doesn't need SFML
+#include <cmath>
+#include <algorithm>
+
+namespace swept {
+    constexpr float epsilon{1e-6f};
+
+    // earliest t in [0, 1] at which a circle of radius r, its center moving from start to
+    // start + move, touches the rect [left, right] x [top, bottom]; above 1 if it never does.
+    // the center has to reach the rect grown by r, which is two crossing slabs and a circle
+    // on each corner, so nothing depends on how long the step was
+    inline float circleRectTime(float startX, float startY, float moveX, float moveY, float r,
+            float left, float top, float right, float bottom) {
+        float best = 2.f;
+        auto slab = [&](float slabLeft, float slabTop, float slabRight, float slabBottom) {
+            float t0 = 0.f;
+            float t1 = 1.f;
+            float lo[2] = {slabLeft, slabTop};
+            float hi[2] = {slabRight, slabBottom};
+            float from[2] = {startX, startY};
+            float step[2] = {moveX, moveY};
+            for (int axis = 0; axis < 2; ++axis) {
+                if (std::abs(step[axis]) < epsilon) {
+                    if (from[axis] < lo[axis] || from[axis] > hi[axis]) return;
+                } else {
+                    float a = (lo[axis] - from[axis]) / step[axis];
+                    float b = (hi[axis] - from[axis]) / step[axis];
+                    t0 = std::max(t0, std::min(a, b));
+                    t1 = std::min(t1, std::max(a, b));
+                }
+            }
+            if (t0 <= t1) best = std::min(best, t0);
+        };
+        slab(left - r, top, right + r, bottom);
+        slab(left, top - r, right, bottom + r);
+
+        float corners[4][2] = {{left, top}, {right, top}, {left, bottom}, {right, bottom}};
+        float a = moveX * moveX + moveY * moveY;
+        for (const float* corner : corners) {
+            float offsetX = startX - corner[0];
+            float offsetY = startY - corner[1];
+            float c = offsetX * offsetX + offsetY * offsetY - r * r;
+            if (c <= 0.f) return 0.f;
+            if (a < epsilon) continue;
+            float b = offsetX * moveX + offsetY * moveY;
+            float discriminant = b * b - a * c;
+            if (discriminant < 0.f) continue;
+            float t = (-b - std::sqrt(discriminant)) / a;
+            if (t >= 0.f && t <= 1.f) best = std::min(best, t);
+        }
+        return best;
+    }
+}
+
+#endif